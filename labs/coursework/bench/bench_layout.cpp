@@ -0,0 +1,159 @@
+// GPU vertex layout benchmark - draws each model in every gpu_mesh vertex layout
+// and format, once with the coursework's shading effect reading every attribute
+// (packed.vert for packed meshes) and once
+// through the position only vertex array as the shadow pass does, timing each
+// with GL_TIME_ELAPSED queries.  The models are drawn a few pixels across so the
+// time goes on fetching and transforming vertices rather than on fragments.
+// Unlike the other benchmarks it needs a GL context, so it opens a window, and
+// closes it once the table is printed.
+// Usage: bench_layout [model.obj ...]
+// With no models given it draws the coursework's own from res/models.
+
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <graphics_framework.h>
+
+#include "gpu_mesh.h"
+#include "mesh_tools.h"
+
+using namespace std;
+using namespace graphics_framework;
+using namespace glm;
+
+// Draws of each model per timed query
+static const unsigned int draws = 100;
+// Frames run before timing starts, and frames timed
+static const unsigned int warm_up_frames = 10;
+static const unsigned int timed_frames = 50;
+
+static const gpu_mesh::vertex_layout layouts[] = { gpu_mesh::vertex_layout::streams,
+	gpu_mesh::vertex_layout::interleaved, gpu_mesh::vertex_layout::split };
+static const char* layout_names[] = { "streams", "interleaved", "split" };
+static const gpu_mesh::vertex_format formats[] = { gpu_mesh::vertex_format::full, gpu_mesh::vertex_format::packed };
+static const char* format_names[] = { "full", "packed" };
+// Every layout in every format
+static const size_t variants = 6;
+
+static vector<string> models;
+// Effects reading each format
+static effect effects[2];
+// One mesh per model and variant
+static vector<vector<gpu_mesh>> meshes;
+static vector<mat4> transforms;
+static vector<size_t> triangles;
+// Summed GPU time in ns of each model, variant and pass (shaded, positions only)
+static vector<vector<array<GLuint64, 2>>> times;
+static GLuint query;
+static unsigned int frame = 0;
+
+static bool load_content()
+{
+	for (auto& filename : models) {
+		obj_data mesh;
+		load_obj(filename, mesh);
+		weld_mesh(mesh);
+		optimise_mesh(mesh);
+		vector<gpu_mesh> variants_of_model;
+		for (auto format : formats) {
+			for (auto layout : layouts) {
+				variants_of_model.emplace_back(mesh, layout, format);
+			}
+		}
+		auto& first = variants_of_model.front();
+		auto centre = (first.get_bounds_min() + first.get_bounds_max()) * 0.5f;
+		auto radius = length(first.get_bounds_max() - first.get_bounds_min()) * 0.5f;
+		// About 2% of the screen across, in the middle of it
+		transforms.push_back(scale(mat4(1.0f), vec3(0.02f / radius)) * translate(mat4(1.0f), -centre));
+		triangles.push_back(mesh.indices.size() / 3);
+		meshes.push_back(move(variants_of_model));
+		times.emplace_back(variants, array<GLuint64, 2>{ { 0, 0 } });
+	}
+
+	const char* vertex_shaders[] = { "res/shaders/shader.vert", "res/shaders/packed.vert" };
+	for (int f = 0; f < 2; ++f) {
+		effects[f].add_shader(vertex_shaders[f], GL_VERTEX_SHADER);
+		if (formats[f] == gpu_mesh::vertex_format::packed) {
+			effects[f].add_shader("res/shaders/part_octahedral.vert", GL_VERTEX_SHADER);
+		}
+		effects[f].add_shader("res/shaders/shader.frag", GL_FRAGMENT_SHADER);
+		effects[f].add_shader("res/shaders/part_direction.frag", GL_FRAGMENT_SHADER);
+		effects[f].add_shader("res/shaders/part_point.frag", GL_FRAGMENT_SHADER);
+		effects[f].add_shader("res/shaders/part_spot.frag", GL_FRAGMENT_SHADER);
+		effects[f].add_shader("res/shaders/part_shadow.frag", GL_FRAGMENT_SHADER);
+		effects[f].build();
+	}
+	glGenQueries(1, &query);
+	return true;
+}
+
+static bool update(float) { return true; }
+
+// Prints the time per frame and throughput of every model, variant and pass
+static void report()
+{
+	cout << draws << " draws per query, " << timed_frames << " frames; GPU ms per frame and Mtriangles/s" << endl;
+	cout << setw(16) << "model" << setw(8) << "format" << setw(13) << "layout" << setw(10) << "shaded" << setw(9) << "Mtri/s"
+		<< setw(10) << "depth" << setw(9) << "Mtri/s" << endl;
+	for (size_t m = 0; m < models.size(); ++m) {
+		auto name = models[m].substr(models[m].find_last_of("/\\") + 1);
+		for (size_t v = 0; v < variants; ++v) {
+			cout << setw(16) << name << setw(8) << format_names[v / 3] << setw(13) << layout_names[v % 3] << fixed;
+			for (auto ns : times[m][v]) {
+				auto ms = ns / 1e6 / timed_frames;
+				cout << setprecision(3) << setw(10) << ms << setprecision(0) << setw(9)
+					<< triangles[m] * draws / (ms * 1000.0);
+			}
+			cout << endl;
+		}
+	}
+}
+
+static bool render()
+{
+	for (size_t m = 0; m < models.size(); ++m) {
+		for (size_t v = 0; v < variants; ++v) {
+			auto& eff = effects[v / 3];
+			renderer::bind(eff);
+			auto MVP = transforms[m] * meshes[m][v].get_position_transform();
+			glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
+			for (int pass = 0; pass < 2; ++pass) {
+				glBeginQuery(GL_TIME_ELAPSED, query);
+				for (unsigned int d = 0; d < draws; ++d) {
+					if (pass == 0) {
+						meshes[m][v].render();
+					} else {
+						meshes[m][v].render_positions();
+					}
+				}
+				glEndQuery(GL_TIME_ELAPSED);
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+				if (frame >= warm_up_frames) {
+					times[m][v][pass] += ns;
+				}
+			}
+		}
+	}
+	if (++frame == warm_up_frames + timed_frames) {
+		report();
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	models.assign(argv + 1, argv + argc);
+	if (models.empty()) {
+		models = { "res/models/teapot_s2.obj", "res/models/car2.obj" };
+	}
+	app application("Vertex layout benchmark");
+	application.set_load_content(load_content);
+	application.set_update(update);
+	application.set_render(render);
+	application.run();
+	return 0;
+}
@@ -0,0 +1,423 @@
+// Headless OBJ loading benchmark - reads each model with a line by line
+// istream reader, the way OBJ files are usually read, and with load_obj on one
+// thread and on the shared pool, and through the mesh cache once it is built.
+// Reports throughput in MB/s of OBJ text and checks that every path gives the
+// same triangles, along with the vertex count left after welding.  The cache of
+// the plain parse is written next to each model as model.obj.bench.mesh,
+// never meeting the processed model.obj.scene.mesh the coursework draws.
+// Usage: bench_obj [repeats] [model.obj ...]
+//        bench_obj --optimise [model.obj ...]   ACMR, ATVR and overdraw of each
+//                                               model before and after optimise_mesh
+//        bench_obj --lod [model.obj ...]        triangles, error and ACMR of each
+//                                               level build_lod_chain makes
+//        bench_obj --clusters [model ...]       clusters build_clusters makes and
+//                                               the triangles their cones cull,
+//                                               for OBJ and 3DS models
+//        bench_obj --3ds [repeats] [model.3ds ...]  load time and peak heap of
+//                                               3DS files read whole then parsed,
+//                                               streamed, mapped and cached
+// With no models given it reads the coursework's own from res/models, and the
+// shared teapot.obj, the largest in the tree, from ../res/models.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "heap_counters.h"
+#include "loader_3ds.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "mesh_simplify.h"
+#include "mesh_tools.h"
+#include "obj_loader.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace glm;
+
+// Reference reader - getline and stream extraction, with a map from each
+// position/texture coordinate/normal triple to its vertex
+static void istream_obj(const string& filename, obj_data& out)
+{
+	ifstream file(filename);
+	if (!file) {
+		throw runtime_error("Could not open " + filename);
+	}
+	vector<vec3> positions, normals;
+	vector<vec2> tex_coords;
+	map<tuple<int, int, int>, uint32_t> vertices;
+	out = obj_data();
+
+	string line;
+	while (getline(file, line)) {
+		istringstream in(line);
+		string keyword;
+		in >> keyword;
+		if (keyword == "v") {
+			vec3 v;
+			in >> v.x >> v.y >> v.z;
+			positions.push_back(v);
+		} else if (keyword == "vt") {
+			vec2 t;
+			in >> t.x >> t.y;
+			tex_coords.push_back(t);
+		} else if (keyword == "vn") {
+			vec3 n;
+			in >> n.x >> n.y >> n.z;
+			normals.push_back(n);
+		} else if (keyword == "f") {
+			vector<uint32_t> face;
+			string corner;
+			while (in >> corner) {
+				// v, v/vt, v//vn or v/vt/vn, 1-based or negative from the end
+				int index[3] = { 0, 0, 0 };
+				istringstream parts(corner);
+				string part;
+				for (int attribute = 0; attribute < 3 && getline(parts, part, '/'); ++attribute) {
+					index[attribute] = part.empty() ? 0 : stoi(part);
+				}
+				int counts[3] = { static_cast<int>(positions.size()), static_cast<int>(tex_coords.size()),
+					static_cast<int>(normals.size()) };
+				for (int attribute = 0; attribute < 3; ++attribute) {
+					index[attribute] = index[attribute] > 0 ? index[attribute] - 1 :
+						index[attribute] < 0 ? counts[attribute] + index[attribute] : -1;
+				}
+				auto key = make_tuple(index[0], index[1], index[2]);
+				auto found = vertices.find(key);
+				if (found == vertices.end()) {
+					found = vertices.emplace(key, static_cast<uint32_t>(out.positions.size())).first;
+					out.positions.push_back(positions[index[0]]);
+					out.tex_coords.push_back(index[1] >= 0 ? tex_coords[index[1]] : vec2(0.0f));
+					out.normals.push_back(index[2] >= 0 ? normals[index[2]] : vec3(0.0f, 1.0f, 0.0f));
+				}
+				face.push_back(found->second);
+			}
+			for (size_t k = 2; k < face.size(); ++k) {
+				out.indices.insert(out.indices.end(), { face[0], face[k - 1], face[k] });
+			}
+		}
+	}
+}
+
+// Whether two loads hold the same triangles with the same corner attributes
+static bool same_mesh(const obj_data& a, const obj_data& b)
+{
+	if (a.indices.size() != b.indices.size() || a.positions.size() != b.positions.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.indices.size(); ++i) {
+		auto va = a.indices[i], vb = b.indices[i];
+		auto close = [](float x, float y) { return abs(x - y) <= 1e-6f * std::max(1.0f, abs(x)); };
+		for (int c = 0; c < 3; ++c) {
+			if (!close(a.positions[va][c], b.positions[vb][c])) {
+				return false;
+			}
+		}
+		// Normals can differ where the file has none and load_obj smooths them
+		if (!close(a.tex_coords[va].x, b.tex_coords[vb].x) || !close(a.tex_coords[va].y, b.tex_coords[vb].y)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Best time of repeats runs of load, in ms
+template <typename F>
+static double best_ms(unsigned int repeats, F load)
+{
+	auto best = 1e30;
+	for (unsigned int r = 0; r < repeats; ++r) {
+		auto start = steady_clock::now();
+		load();
+		best = std::min(best, duration<double, milli>(steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+// Vertex cache and overdraw statistics of welded models in file order and
+// after each optimisation pass
+static int check_optimise(const vector<string>& models)
+{
+	cout << setw(16) << "model" << setw(16) << "pass" << setw(8) << "ACMR" << setw(8) << "ATVR"
+		<< setw(10) << "overdraw" << setw(9) << "ms" << endl;
+	for (auto& filename : models) {
+		obj_data mesh;
+		load_obj(filename, mesh);
+		weld_mesh(mesh);
+		auto name = filename.substr(filename.find_last_of("/\\") + 1);
+		auto report = [&](const char* pass, double ms) {
+			auto stats = simulate_vertex_cache(mesh.indices.data(), mesh.indices.size());
+			cout << setw(16) << name << setw(16) << pass << fixed << setprecision(3) << setw(8) << stats.acmr()
+				<< setw(8) << stats.atvr() << setw(10) << measure_overdraw(mesh) << setprecision(2) << setw(9) << ms
+				<< endl;
+		};
+		report("file order", 0.0);
+		auto ms = best_ms(1, [&]() { optimise_vertex_cache(mesh.indices.data(), mesh.indices.size(), mesh.positions.size()); });
+		report("vertex cache", ms);
+		ms = best_ms(1, [&]() { optimise_overdraw(mesh); });
+		report("overdraw", ms);
+		ms = best_ms(1, [&]() { optimise_vertex_fetch(mesh); });
+		report("vertex fetch", ms);
+	}
+	return 0;
+}
+
+// Levels of detail of welded, optimised models
+static int check_lod(const vector<string>& models)
+{
+	cout << setw(16) << "model" << setw(7) << "level" << setw(11) << "triangles" << setw(12) << "error"
+		<< setw(11) << "error/size" << setw(8) << "ACMR" << setw(9) << "ms" << endl;
+	for (auto& filename : models) {
+		obj_data mesh;
+		load_obj(filename, mesh);
+		weld_mesh(mesh);
+		optimise_mesh(mesh);
+		auto ms = best_ms(1, [&]() { build_lod_chain(mesh); });
+		vec3 low = mesh.positions[0], high = mesh.positions[0];
+		for (auto& p : mesh.positions) {
+			low = min(low, p);
+			high = max(high, p);
+		}
+		auto size = std::max(std::max(high.x - low.x, high.y - low.y), high.z - low.z);
+		auto name = filename.substr(filename.find_last_of("/\\") + 1);
+		for (size_t level = 0; level < mesh.lods.size(); ++level) {
+			auto& lod = mesh.lods[level];
+			auto stats = simulate_vertex_cache(mesh.indices.data() + lod.first, lod.count);
+			cout << setw(16) << name << setw(7) << level << setw(11) << lod.count / 3 << setprecision(5) << setw(12)
+				<< lod.error << fixed << setprecision(4) << setw(11) << lod.error / size << setprecision(3) << setw(8)
+				<< stats.acmr() << setprecision(2) << setw(9) << (level == 0 ? ms : 0.0) << defaultfloat << endl;
+		}
+	}
+	return 0;
+}
+
+// Clusters of the full level of welded, optimised models, and the share of its
+// triangles the normal cones cull from eyes all round the model.  3DS models
+// have their objects merged into one mesh, as the coursework draws them.
+static int check_clusters(const vector<string>& models)
+{
+	cout << setw(16) << "model" << setw(11) << "triangles" << setw(10) << "clusters" << setw(10) << "vertices"
+		<< setw(10) << "coned" << setw(10) << "culled" << setw(9) << "ms" << endl;
+	for (auto& filename : models) {
+		obj_data mesh;
+		if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".3ds") == 0) {
+			mapped_file file(filename);
+			parse_3ds(file.data(), file.size(), mesh, filename);
+		} else {
+			load_obj(filename, mesh);
+		}
+		weld_mesh(mesh);
+		optimise_mesh(mesh);
+		auto ms = best_ms(1, [&]() { build_clusters(mesh); });
+		vec3 low = mesh.positions[0], high = mesh.positions[0];
+		for (auto& p : mesh.positions) {
+			low = min(low, p);
+			high = max(high, p);
+		}
+		auto centre = (low + high) * 0.5f;
+		auto radius = length(high - low) * 0.5f;
+
+		// Mean vertices per cluster, and the share of clusters whose faces are close enough to cull by
+		size_t vertices = 0, coned = 0;
+		vector<uint32_t> stamp(mesh.positions.size(), UINT32_MAX);
+		for (uint32_t c = 0; c < mesh.clusters.size(); ++c) {
+			auto& cluster = mesh.clusters[c];
+			for (auto i = cluster.first; i < cluster.first + cluster.count; ++i) {
+				if (stamp[mesh.indices[i]] != c) {
+					stamp[mesh.indices[i]] = c;
+					++vertices;
+				}
+			}
+			coned += cluster.cone_cutoff < 1.0f;
+		}
+
+		// Eyes on a sphere three times the model's radius out, along the axes and the diagonals between them
+		size_t culled = 0, views = 0;
+		for (int x = -1; x <= 1; ++x) {
+			for (int y = -1; y <= 1; ++y) {
+				for (int z = -1; z <= 1; ++z) {
+					if (x == 0 && y == 0 && z == 0) {
+						continue;
+					}
+					auto eye = centre + normalize(vec3(x, y, z)) * radius * 3.0f;
+					for (auto& cluster : mesh.clusters) {
+						culled += cluster_faces_away(cluster, eye) ? cluster.count / 3 : 0;
+					}
+					++views;
+				}
+			}
+		}
+
+		auto name = filename.substr(filename.find_last_of("/\\") + 1);
+		auto clusters = mesh.clusters.size();
+		cout << setw(16) << name << setw(11) << mesh.indices.size() / 3 << setw(10) << clusters << fixed
+			<< setprecision(1) << setw(10) << static_cast<double>(vertices) / clusters << setw(9)
+			<< 100.0 * coned / clusters << "%" << setw(9) << 100.0 * culled / (views * mesh.indices.size() / 3.0)
+			<< "%" << setprecision(2) << setw(9) << ms << defaultfloat << endl;
+	}
+	return 0;
+}
+
+// 3DS files read whole into memory and parsed, as a generic importer reads
+// them, against load_3ds streaming them, parse_3ds over a mapping and the
+// mesh cache; each with its time and the most heap it held at once
+static int check_3ds(unsigned int repeats, const vector<string>& models)
+{
+	cout << "best of " << repeats << " loads; ms and peak heap in KB" << endl;
+	cout << setw(14) << "model" << setw(9) << "KB" << setw(8) << "objects" << setw(10) << "vertices"
+		<< setw(11) << "triangles" << setw(10) << "whole" << setw(8) << "KB" << setw(10) << "streamed" << setw(8)
+		<< "KB" << setw(10) << "mapped" << setw(8) << "KB" << setw(10) << "cached" << setw(8) << "KB" << endl;
+	auto failed = false;
+	for (auto& filename : models) {
+		// Runs a load, returning its best time and the heap it held at its peak beyond what was live before
+		auto measure = [&](const function<void()>& load, double& kb) {
+			auto before = heap_live_bytes.load();
+			heap_peak_bytes = before;
+			auto ms = best_ms(repeats, load);
+			kb = (heap_peak_bytes - before) / 1024.0;
+			return ms;
+		};
+
+		vector<object_3ds> whole, streamed, mapped;
+		double whole_kb, streamed_kb, mapped_kb, cached_kb;
+		auto whole_ms = measure([&]() {
+			ifstream file(filename, ios::binary | ios::ate);
+			vector<char> data(static_cast<size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(data.data(), data.size());
+			parse_3ds(data.data(), data.size(), whole, filename);
+		}, whole_kb);
+		auto streamed_ms = measure([&]() { load_3ds(filename, streamed); }, streamed_kb);
+		auto mapped_ms = measure([&]() {
+			mapped_file file(filename);
+			parse_3ds(file.data(), file.size(), mapped, filename);
+		}, mapped_kb);
+
+		// Every object merged, as the cache holds it, once the first open has built it
+		auto parse = [&](const char* data, size_t size, obj_data& out) { parse_3ds(data, size, out, filename); };
+		cached_mesh::open(filename, "bench", parse);
+		cached_mesh cached;
+		auto cached_ms = measure([&]() { cached = cached_mesh::open(filename, "bench", parse); }, cached_kb);
+
+		size_t vertices = 0, triangles = 0;
+		for (size_t i = 0; i < streamed.size(); ++i) {
+			vertices += streamed[i].mesh.positions.size();
+			triangles += streamed[i].mesh.indices.size() / 3;
+			failed |= whole.size() != streamed.size() || mapped.size() != streamed.size() ||
+				!same_mesh(whole[i].mesh, streamed[i].mesh) || !same_mesh(mapped[i].mesh, streamed[i].mesh);
+		}
+		failed |= cached.vertex_count() != vertices || cached.index_count() != triangles * 3;
+
+		auto name = filename.substr(filename.find_last_of("/\\") + 1);
+		cout << setw(14) << name << fixed << setprecision(0) << setw(9) << mapped_file(filename).size() / 1024.0
+			<< setw(8) << streamed.size() << setw(10) << vertices << setw(11) << triangles;
+		for (auto result : { make_pair(whole_ms, whole_kb), make_pair(streamed_ms, streamed_kb),
+				make_pair(mapped_ms, mapped_kb), make_pair(cached_ms, cached_kb) }) {
+			cout << setprecision(3) << setw(10) << result.first << setprecision(0) << setw(8) << result.second;
+		}
+		cout << defaultfloat << endl;
+	}
+	if (failed) {
+		cout << "MISMATCH between the 3DS loads" << endl;
+	}
+	return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "--optimise") == 0) {
+		vector<string> models(argv + 2, argv + argc);
+		if (models.empty()) {
+			models = { "../res/models/teapot.obj", "res/models/car2.obj" };
+		}
+		return check_optimise(models);
+	}
+	if (argc > 1 && strcmp(argv[1], "--lod") == 0) {
+		vector<string> models(argv + 2, argv + argc);
+		if (models.empty()) {
+			models = { "../res/models/teapot.obj", "res/models/teapot_s2.obj", "res/models/car2.obj" };
+		}
+		return check_lod(models);
+	}
+	if (argc > 1 && strcmp(argv[1], "--clusters") == 0) {
+		vector<string> models(argv + 2, argv + argc);
+		if (models.empty()) {
+			models = { "../res/models/teapot.obj", "res/models/teapot_s2.obj", "res/models/car2.obj",
+				"../res/models/Skull.3ds" };
+		}
+		return check_clusters(models);
+	}
+	if (argc > 1 && strcmp(argv[1], "--3ds") == 0) {
+		auto repeats = argc > 2 ? static_cast<unsigned int>(atoi(argv[2])) : 5;
+		vector<string> models(argv + std::min(argc, 3), argv + argc);
+		if (models.empty()) {
+			models = { "../res/models/Skull.3ds", "../res/models/suzanne.3ds" };
+		}
+		return check_3ds(repeats, models);
+	}
+
+	unsigned int repeats = argc > 1 ? static_cast<unsigned int>(atoi(argv[1])) : 5;
+	vector<string> models;
+	for (int i = 2; i < argc; ++i) {
+		models.push_back(argv[i]);
+	}
+	if (models.empty()) {
+		models = { "../res/models/teapot.obj", "res/models/teapot_s0.obj", "res/models/teapot_s1.obj",
+			"res/models/teapot_s2.obj", "res/models/car.obj", "res/models/car2.obj" };
+	}
+
+	thread_pool single(1);
+	auto& shared = thread_pool::shared();
+	cout << "threads: " << shared.size() << endl;
+	cout << "best of " << repeats << " loads; throughput in MB/s of OBJ text" << endl;
+	cout << setw(16) << "model" << setw(9) << "MB" << setw(10) << "vertices" << setw(11) << "triangles"
+		<< setw(10) << "istream" << setw(10) << "1 thread" << setw(10) << "pool" << setw(9) << "speedup"
+		<< setw(10) << "cached" << setw(8) << "welded" << endl;
+
+	auto failed = false;
+	for (auto& filename : models) {
+		double mb = mapped_file(filename).size() / (1024.0 * 1024.0);
+		obj_data reference, fast;
+		auto reference_ms = best_ms(repeats, [&]() { istream_obj(filename, reference); });
+		auto single_ms = best_ms(repeats, [&]() { load_obj(filename, fast, single); });
+		auto pool_ms = best_ms(repeats, [&]() { load_obj(filename, fast, shared); });
+
+		// Hashing the source and mapping the cache, once the first open has built it
+		auto parse = [&](const char* data, size_t size, obj_data& out) { parse_obj(data, size, out, shared, filename); };
+		cached_mesh::open(filename, "bench", parse);
+		cached_mesh cached;
+		auto cached_ms = best_ms(repeats, [&]() { cached = cached_mesh::open(filename, "bench", parse); });
+		obj_data from_cache;
+		from_cache.positions.assign(cached.positions(), cached.positions() + cached.vertex_count());
+		from_cache.normals.assign(cached.normals(), cached.normals() + cached.vertex_count());
+		from_cache.tex_coords.assign(cached.tex_coords(), cached.tex_coords() + cached.vertex_count());
+		from_cache.indices.assign(cached.indices(), cached.indices() + cached.index_count());
+
+		auto welded = fast;
+		auto weld = weld_mesh(welded);
+
+		auto name = filename.substr(filename.find_last_of("/\\") + 1);
+		cout << setw(16) << name << fixed << setprecision(2) << setw(9) << mb << setw(10) << fast.positions.size()
+			<< setw(11) << fast.indices.size() / 3 << setprecision(1) << setw(10) << mb / (reference_ms / 1000.0)
+			<< setw(10) << mb / (single_ms / 1000.0) << setw(10) << mb / (pool_ms / 1000.0)
+			<< setw(8) << reference_ms / pool_ms << "x" << setw(10) << mb / (cached_ms / 1000.0)
+			<< setw(8) << weld.vertices_after;
+		if (!same_mesh(reference, fast) || !same_mesh(fast, from_cache)) {
+			cout << "  MISMATCH";
+			failed = true;
+		}
+		cout << endl;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,340 @@
+// Headless terrain build benchmark - times build_terrain on synthetic height maps
+// from 256x256 up to 8192x8192, and on any height map files given, with both the
+// original scatter normals and the gather kernel.  Each stage reports its wall
+// time, allocations and the bytes that would be uploaded, along with how far
+// the build grew the resident set.
+// No GL context is needed, so it runs on a machine without a GPU.
+// Usage: bench_terrain [max_resolution] [repeats] [height map ...]
+//        bench_terrain --normals <height map>   compare gather normals against a
+//                                               triangle scatter on a real map
+//        bench_terrain --raycast <height map>   check and time heightfield ray
+//                                               casts, in memory and over tiles,
+//                                               against testing every cell
+//        bench_terrain --cache                  vertex cache use of the grid index
+//                                               orders and their index memory
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "heap_counters.h"
+#include "heightfield.h"
+#include "tiled_heightfield.h"
+#include "terrain.h"
+#include "vertex_cache.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace glm;
+
+// Rolling sine hills in the range 0-1, similar to res/textures/sinemap2.png
+static heightmap synthetic_heights(unsigned int resolution)
+{
+	vector<float> heights(static_cast<size_t>(resolution) * resolution);
+	for (unsigned int z = 0; z < resolution; ++z) {
+		for (unsigned int x = 0; x < resolution; ++x) {
+			auto u = static_cast<float>(x) / resolution * 12.0f;
+			auto v = static_cast<float>(z) / resolution * 12.0f;
+			heights[static_cast<size_t>(z) * resolution + x] = 0.5f + 0.25f * sin(u) + 0.25f * cos(v);
+		}
+	}
+	return heightmap::from_floats(resolution, resolution, heights.data());
+}
+
+// Resident set size of the process right now in bytes.  Unlike the peak, which
+// only ever grows, it falls back once a build frees its buffers, so each build
+// can report its own.
+static size_t current_rss()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.WorkingSetSize;
+#else
+	// Second field of statm is the resident page count
+	size_t pages = 0, resident = 0;
+	if (auto file = fopen("/proc/self/statm", "r")) {
+		if (fscanf(file, "%zu %zu", &pages, &resident) != 2) {
+			resident = 0;
+		}
+		fclose(file);
+	}
+	return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// Cost of one stage of build_terrain
+struct stage_cost
+{
+	double ms = 0.0;
+	size_t allocations = 0;
+	size_t bytes = 0;
+};
+
+// Stage costs of a build: vertices, indices, normals
+struct build_cost
+{
+	stage_cost stages[3];
+	// Bytes of buffers handed to the GPU: positions, normals, texture coordinates, weights and indices
+	size_t upload_bytes = 0;
+	// Most the resident set grew over its size before the build, at the end of any stage
+	size_t rss_bytes = 0;
+	double total_ms() const { return stages[0].ms + stages[1].ms + stages[2].ms; }
+};
+
+// Best time of each stage over a number of fresh builds
+static build_cost time_build(const heightmap& map, terrain_normals normals, unsigned int repeats)
+{
+	build_cost best;
+	for (unsigned int r = 0; r < repeats; ++r) {
+		// A fresh terrain each run so allocation is part of the cost, as it is at load
+		terrain_data terrain;
+		build_cost cost;
+		auto last = steady_clock::now();
+		size_t last_allocations = heap_allocations, last_bytes = heap_allocated_bytes;
+#ifdef __GLIBC__
+		// Hand the heap the last build freed back, or this one reuses it unseen
+		malloc_trim(0);
+#endif
+		auto rss_before = current_rss();
+		build_terrain(terrain, map, map.get_width(), map.get_height(), 3.0f, true, normals, thread_pool::shared(),
+			[&](terrain_stage stage) {
+				auto now = steady_clock::now();
+				auto& s = cost.stages[static_cast<int>(stage)];
+				s.ms = duration<double, milli>(now - last).count();
+				s.allocations = heap_allocations - last_allocations;
+				s.bytes = heap_allocated_bytes - last_bytes;
+				last = now;
+				last_allocations = heap_allocations;
+				last_bytes = heap_allocated_bytes;
+				auto rss = current_rss();
+				cost.rss_bytes = std::max(cost.rss_bytes, rss > rss_before ? rss - rss_before : 0);
+			});
+		cost.upload_bytes = terrain.positions.size() * sizeof(vec3) + terrain.normals.size() * sizeof(vec3)
+			+ terrain.tex_coords.size() * sizeof(vec2) + terrain.tex_weights.size() * sizeof(vec4)
+			+ terrain.indices.size() * sizeof(unsigned int);
+		if (r == 0) {
+			best = cost;
+			continue;
+		}
+		for (int i = 0; i < 3; ++i) {
+			best.stages[i].ms = std::min(best.stages[i].ms, cost.stages[i].ms);
+		}
+		best.rss_bytes = std::max(best.rss_bytes, cost.rss_bytes);
+	}
+	return best;
+}
+
+// Prints one row of the results table
+static void report(const string& name, const heightmap& map, terrain_normals normals, unsigned int repeats)
+{
+	auto cost = time_build(map, normals, repeats);
+	auto mvertices = static_cast<double>(map.get_width()) * map.get_height() / 1.0e6;
+	size_t stage_allocations = 0, stage_bytes = 0;
+	for (auto& s : cost.stages) {
+		stage_allocations += s.allocations;
+		stage_bytes += s.bytes;
+	}
+	cout << setw(16) << name << setw(9) << (normals == terrain_normals::scatter ? "scatter" : "gather")
+		<< fixed << setprecision(2)
+		<< setw(11) << cost.stages[0].ms << setw(11) << cost.stages[1].ms << setw(11) << cost.stages[2].ms
+		<< setw(11) << cost.total_ms() << setw(12) << cost.total_ms() / mvertices
+		<< setw(9) << stage_allocations << setw(11) << stage_bytes / (1024.0 * 1024.0)
+		<< setw(11) << cost.upload_bytes / (1024.0 * 1024.0) << setw(11) << cost.rss_bytes / (1024.0 * 1024.0) << endl;
+}
+
+// Compares gather normals with area weighted triangle normals scattered into
+// the vertices, the result the original generator was meant to produce
+static int check_normals(const char* filename)
+{
+	heightmap map(filename);
+	auto w = map.get_width();
+	auto h = map.get_height();
+	float cell_width = 45.0f / w;
+	float cell_depth = 45.0f / h;
+
+	vector<vec3> gathered;
+	compute_heightfield_normals(map, cell_width, cell_depth, 3.0f, gathered);
+
+	// Scatter the two triangles of every cell
+	vector<vec3> scattered(gathered.size(), vec3(0.0f));
+	auto position = [&](unsigned int x, unsigned int z) { return vec3(x * cell_width, map.get(x, z) * 3.0f, z * cell_depth); };
+	for (unsigned int z = 0; z + 1 < h; ++z) {
+		for (unsigned int x = 0; x + 1 < w; ++x) {
+			auto p0 = position(x, z), p1 = position(x, z + 1), p2 = position(x + 1, z + 1), p3 = position(x + 1, z);
+			auto n1 = cross(p1 - p0, p2 - p0);
+			auto n2 = cross(p2 - p0, p3 - p0);
+			scattered[z * w + x] += n1 + n2;
+			scattered[(z + 1) * w + x] += n1;
+			scattered[(z + 1) * w + x + 1] += n1 + n2;
+			scattered[z * w + x + 1] += n2;
+		}
+	}
+
+	// Angle between the two on interior vertices (edges differ by construction)
+	double worst = 0.0, total = 0.0;
+	size_t count = 0;
+	for (unsigned int z = 1; z + 1 < h; ++z) {
+		for (unsigned int x = 1; x + 1 < w; ++x) {
+			auto d = std::min(1.0f, dot(normalize(scattered[z * w + x]), gathered[z * w + x]));
+			auto angle = degrees(acos(d));
+			worst = std::max(worst, static_cast<double>(angle));
+			total += angle;
+			++count;
+		}
+	}
+	cout << filename << " " << w << "x" << h << ": max " << worst << " deg, mean " << total / count << " deg" << endl;
+	// Central differences and the cell triangulation agree closely on smooth maps
+	return worst < 1.0 ? 0 : 1;
+}
+
+// Casts random rays down onto a map with the min/max pyramid, through a tiled
+// copy of the map walked a tile at a time, and by testing every cell in turn,
+// which must all find the same first hit
+static int check_raycast(const char* filename)
+{
+	heightmap map(filename);
+	tiled_heightfield::write(map, "bench_raycast.thf", 64);
+	heightfield field(move(map), 45, 45, 3.0f);
+	tiled_heightfield tiles("bench_raycast.thf");
+	heightfield tiled_field(tiles, 45, 45, 3.0f);
+	auto cells_x = field.get_map_width() - 1;
+	auto cells_z = field.get_map_height() - 1;
+
+	mt19937 rng(1);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	const int rays = 200;
+	int hits = 0, mismatches = 0;
+	double fast_ms = 0.0, tiled_ms = 0.0, brute_ms = 0.0;
+	for (int r = 0; r < rays; ++r) {
+		vec3 origin(unit(rng) * 25.0f, 5.0f + unit(rng) * 2.0f, unit(rng) * 25.0f);
+		auto dir = normalize(vec3(unit(rng), -0.3f + 0.3f * unit(rng), unit(rng)));
+
+		auto start = steady_clock::now();
+		float t = 0.0f;
+		auto hit = field.raycast(origin, dir, 100.0f, t);
+		fast_ms += duration<double, milli>(steady_clock::now() - start).count();
+
+		start = steady_clock::now();
+		float tiled_t = 0.0f;
+		auto tiled_hit = tiled_field.raycast(origin, dir, 100.0f, tiled_t);
+		tiled_ms += duration<double, milli>(steady_clock::now() - start).count();
+
+		start = steady_clock::now();
+		float brute_t = 100.0f;
+		bool brute_hit = false;
+		for (unsigned int z = 0; z < cells_z; ++z) {
+			for (unsigned int x = 0; x < cells_x; ++x) {
+				brute_hit |= field.raycast_cell(origin, dir, x, z, brute_t);
+			}
+		}
+		brute_ms += duration<double, milli>(steady_clock::now() - start).count();
+
+		hits += hit ? 1 : 0;
+		if (hit != brute_hit || (hit && abs(t - brute_t) > 1e-4f) || tiled_hit != brute_hit ||
+			(tiled_hit && abs(tiled_t - brute_t) > 1e-4f)) {
+			++mismatches;
+		}
+	}
+	remove("bench_raycast.thf");
+	cout << filename << ": " << hits << "/" << rays << " rays hit, " << mismatches << " mismatches, "
+		<< fast_ms / rays * 1000.0 << " us per ray, " << tiled_ms / rays * 1000.0 << " us tiled, against "
+		<< brute_ms / rays * 1000.0 << " us testing every cell" << endl;
+	return mismatches == 0 ? 0 : 1;
+}
+
+// Simulated post-transform cache use of row and strip ordered chunk grids at
+// each size, with the index memory at 32 and 16 bits, and of build_terrain's
+// own column order for comparison
+static int check_cache()
+{
+	cout << setw(8) << "cells" << setw(8) << "order" << setw(7) << "cache" << setw(8) << "ACMR" << setw(8) << "ATVR"
+		<< setw(11) << "32-bit KB" << setw(11) << "16-bit KB" << endl;
+	for (unsigned int cells = 16; cells <= 256; cells *= 2) {
+		// 16-bit indices need every vertex of the grid addressable
+		auto fits_short = (cells + 1) * (cells + 1) <= 65536;
+		for (auto order : { grid_order::rows, grid_order::strips }) {
+			for (unsigned int cache_size : { 16u, 32u }) {
+				vector<uint32_t> indices;
+				grid_indices(cells, 1, order, indices, cache_size);
+				auto stats = simulate_vertex_cache(indices.data(), indices.size(), cache_size);
+				cout << setw(8) << cells << setw(8) << (order == grid_order::rows ? "rows" : "strips")
+					<< setw(7) << cache_size << fixed << setprecision(3) << setw(8) << stats.acmr()
+					<< setw(8) << stats.atvr() << setprecision(1)
+					<< setw(11) << indices.size() * sizeof(uint32_t) / 1024.0;
+				if (fits_short) {
+					cout << setw(11) << indices.size() * sizeof(uint16_t) / 1024.0;
+				} else {
+					cout << setw(11) << "-";
+				}
+				cout << endl;
+			}
+		}
+	}
+
+	terrain_data data;
+	build_terrain(data, synthetic_heights(257), 45, 45, 3.0f);
+	for (unsigned int cache_size : { 16u, 32u }) {
+		auto stats = simulate_vertex_cache(data.indices.data(), data.indices.size(), cache_size);
+		cout << setw(8) << 256 << setw(8) << "terrain" << setw(7) << cache_size << fixed << setprecision(3)
+			<< setw(8) << stats.acmr() << setw(8) << stats.atvr() << endl;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 2 && strcmp(argv[1], "--normals") == 0) {
+		return check_normals(argv[2]);
+	}
+	if (argc > 2 && strcmp(argv[1], "--raycast") == 0) {
+		return check_raycast(argv[2]);
+	}
+	if (argc > 1 && strcmp(argv[1], "--cache") == 0) {
+		return check_cache();
+	}
+
+	unsigned int max_resolution = argc > 1 ? static_cast<unsigned int>(atoi(argv[1])) : 8192;
+	unsigned int repeats = argc > 2 ? static_cast<unsigned int>(atoi(argv[2])) : 3;
+
+	cout << "threads: " << thread_pool::shared().size() << endl;
+	cout << "stage times are the best of " << repeats << " builds in ms; allocations and MB are per build" << endl;
+	cout << setw(16) << "map" << setw(9) << "normals" << setw(11) << "vertices" << setw(11) << "indices"
+		<< setw(11) << "normals" << setw(11) << "total" << setw(12) << "ms/Mvertex" << setw(9) << "allocs"
+		<< setw(11) << "alloc MB" << setw(11) << "upload MB" << setw(11) << "RSS MB" << endl;
+
+	for (unsigned int resolution = 256; resolution <= max_resolution; resolution *= 2) {
+		auto map = synthetic_heights(resolution);
+		auto name = to_string(resolution) + "x" + to_string(resolution);
+		report(name, map, terrain_normals::scatter, repeats);
+		report(name, map, terrain_normals::gather, repeats);
+	}
+
+	// Real height maps at their own size
+	for (int i = 3; i < argc; ++i) {
+		heightmap map(argv[i]);
+		string name = argv[i];
+		name = name.substr(name.find_last_of("/\\") + 1);
+		report(name, map, terrain_normals::scatter, repeats);
+		report(name, map, terrain_normals::gather, repeats);
+	}
+	return 0;
+}
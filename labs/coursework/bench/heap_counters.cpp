@@ -0,0 +1,61 @@
+#include "heap_counters.h"
+
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+atomic<size_t> heap_allocations(0);
+atomic<size_t> heap_allocated_bytes(0);
+atomic<size_t> heap_live_bytes(0);
+atomic<size_t> heap_peak_bytes(0);
+
+// Size the allocator gave a block, asked of it again when the block is freed,
+// so nothing is stored alongside the block
+static size_t block_size(void* p)
+{
+#ifdef _WIN32
+	return _msize(p);
+#elif defined(__APPLE__)
+	return malloc_size(p);
+#elif defined(__GLIBC__)
+	return malloc_usable_size(p);
+#else
+	return 0;
+#endif
+}
+
+void* operator new(size_t size)
+{
+	auto p = malloc(size ? size : 1);
+	if (!p) {
+		throw bad_alloc();
+	}
+	++heap_allocations;
+	heap_allocated_bytes += size;
+	auto live = heap_live_bytes += block_size(p);
+	auto peak = heap_peak_bytes.load();
+	while (live > peak && !heap_peak_bytes.compare_exchange_weak(peak, live)) {
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	if (p) {
+		heap_live_bytes -= block_size(p);
+		free(p);
+	}
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	operator delete(p);
+}
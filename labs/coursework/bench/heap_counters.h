@@ -0,0 +1,17 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Counters kept by the global operator new and delete that heap_counters.cpp
+// replaces, for the benchmarks to report what each stage allocates.  The hooks
+// sit in their own file so they are never inlined into callers, where GCC takes
+// free() of a block from operator new for a mismatched pair.
+
+// Allocations made, and the bytes asked for, since the program started
+extern std::atomic<size_t> heap_allocations;
+extern std::atomic<size_t> heap_allocated_bytes;
+// Bytes in live blocks, at the size the allocator gave each, and their high
+// water mark.  Both stay 0 where the allocator cannot tell a block's size.
+extern std::atomic<size_t> heap_live_bytes;
+extern std::atomic<size_t> heap_peak_bytes;
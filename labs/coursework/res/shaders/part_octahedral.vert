@@ -0,0 +1,10 @@
+// Unfolds a unit vector from the octahedron encode_octahedral (vertex_packing.h)
+// projected it onto, the convention of every packed normal
+vec3 decode_octahedral(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  // The lower half was folded over the upper one
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
@@ -7,12 +7,26 @@ uniform mat4 MVP;
 // The normal matrix
 uniform mat3 N;
 
-// Incoming position
-layout(location = 0) in vec3 position;
-// Incoming normal
-layout(location = 2) in vec3 normal;
-// Incoming texture coordinates
-layout(location = 10) in vec2 tex_coord_in;
+// Terrain layout and the chunk in each vertex buffer slot (terrain_lod::chunk_table)
+layout(std430, binding = 0) buffer terrain_chunks {
+  // Distance between samples along x and z
+  vec2 cell_size;
+  // Position of sample (0, 0)
+  vec2 origin;
+  // Last sample along x and z
+  uvec2 last_sample;
+  // Cells along each side of a chunk
+  uint chunk_cells;
+  // Height of a full scale sample
+  float height_scale;
+  // Per slot - first sample x and z, skirt height
+  vec4 chunks[];
+};
+
+// Incoming height, 0-1
+layout(location = 0) in float height;
+// Incoming octahedral normal
+layout(location = 2) in vec2 packed_normal;
 
 // Outgoing position
 layout(location = 0) out vec3 vertex_position;
@@ -21,13 +35,38 @@ layout(location = 1) out vec3 transformed_normal;
 // Outgoing texture coordinate
 layout(location = 2) out vec2 tex_coord_out;
 
+// Unfolds an octahedral normal, from part_octahedral.vert
+vec3 decode_octahedral(vec2 e);
+
 void main() {
+  // Base vertex puts each chunk in its own slot, so the id gives both the slot
+  // and the vertex within the chunk: the grid, then a skirt along each side
+  uint side_vertices = chunk_cells + 1;
+  uint grid_vertices = side_vertices * side_vertices;
+  uint chunk_vertices = grid_vertices + 4 * side_vertices;
+  uint index = uint(gl_VertexID) % chunk_vertices;
+  vec4 chunk = chunks[uint(gl_VertexID) / chunk_vertices];
+
+  uvec2 cell;
+  float y = height * height_scale;
+  if (index < grid_vertices) {
+    cell = uvec2(index % side_vertices, index / side_vertices);
+  } else {
+    uint side = (index - grid_vertices) / side_vertices;
+    uint t = (index - grid_vertices) % side_vertices;
+    cell = side == 0 ? uvec2(t, 0) : side == 1 ? uvec2(t, chunk_cells) : side == 2 ? uvec2(0, t) : uvec2(chunk_cells, t);
+    y = chunk.z;
+  }
+  // Cells past the map edge collapse onto it
+  vec2 sample_pos = vec2(min(uvec2(chunk.xy) + cell, last_sample));
+  vec3 position = vec3(origin.x + cell_size.x * sample_pos.x, y, origin.y + cell_size.y * sample_pos.y);
+
   // Set position
   gl_Position = MVP * vec4(position, 1);
   // *********************************
   // Output other values to fragment shader
   vertex_position = (M * vec4(position, 1)).xyz;
-  transformed_normal = N * normal;
-  tex_coord_out = tex_coord_in;
+  transformed_normal = N * decode_octahedral(packed_normal);
+  tex_coord_out = cell_size * sample_pos;
   // *********************************
-}
\ No newline at end of file
+}
@@ -0,0 +1,33 @@
+#include "asset_loader.h"
+
+using namespace std;
+using namespace std::chrono;
+
+asset_loader::asset_loader(unsigned int threads) : _workers(threads) {}
+
+void asset_loader::queue(function<void()> upload)
+{
+	_pending.push_back({ []() { return true; }, move(upload) });
+	++_queued;
+}
+
+bool asset_loader::upload(double budget_ms)
+{
+	auto start = steady_clock::now();
+	// By index, as an upload can queue more work
+	for (size_t i = 0; i < _pending.size();) {
+		if (!_pending[i].ready()) {
+			++i;
+			continue;
+		}
+		// Taken off the queue first, so a failed asset is reported once
+		auto job = move(_pending[i].upload);
+		_pending.erase(_pending.begin() + i);
+		++_finished;
+		job();
+		if (duration<double, milli>(steady_clock::now() - start).count() >= budget_ms) {
+			break;
+		}
+	}
+	return _pending.empty();
+}
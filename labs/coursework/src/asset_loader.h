@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "thread_pool.h"
+
+// Loads assets in two halves: reading and decoding files on worker threads, then
+// creating GL objects from the results on the main thread, which owns the
+// context.  Call upload() once a frame; it finishes whatever is decoded, oldest
+// first, until its time budget runs out, so the first frame is not held up by
+// the whole content and a loading frame can be drawn meanwhile.
+class asset_loader
+{
+private:
+	// Main thread half of an asset, waiting on its decode
+	struct pending
+	{
+		std::function<bool()> ready;
+		std::function<void()> upload;
+	};
+
+	// Workers of its own, so decodes can use the shared pool for their own work
+	thread_pool _workers;
+	std::deque<pending> _pending;
+	size_t _queued = 0;
+	size_t _finished = 0;
+
+public:
+	explicit asset_loader(unsigned int threads = std::thread::hardware_concurrency());
+
+	// Runs decode on a worker, then upload(result) on the main thread once it is done
+	template <typename Decode, typename Upload>
+	void load(Decode&& decode, Upload&& upload)
+	{
+		using result_type = decltype(decode());
+		auto result = std::make_shared<std::future<result_type>>(_workers.submit(std::forward<Decode>(decode)));
+		_pending.push_back({ [result]() { return result->wait_for(std::chrono::seconds(0)) == std::future_status::ready; },
+			[result, upload = std::forward<Upload>(upload)]() { upload(result->get()); } });
+		++_queued;
+	}
+
+	// Runs work that needs the context and has nothing to decode, in turn with the rest
+	void queue(std::function<void()> upload);
+
+	// Uploads decoded assets until budget_ms has passed, returning true once every
+	// asset queued is loaded.  A decode that failed throws its exception here.
+	bool upload(double budget_ms);
+
+	bool done() const { return _pending.empty(); }
+	// Fraction of the queued assets loaded, 1 when nothing is queued
+	float progress() const { return _queued == 0 ? 1.0f : static_cast<float>(_finished) / _queued; }
+};
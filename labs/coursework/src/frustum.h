@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// The six clip planes of a view-projection matrix, used to cull bounding volumes.
+// Built from P * V * M the planes are in the model's own space.
+struct frustum
+{
+	// left, right, bottom, top, near, far - xyz is the inward normal, w the offset
+	glm::vec4 planes[6];
+
+	explicit frustum(const glm::mat4& clip)
+	{
+		// Rows of the (column-major) matrix
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; ++i) {
+			row[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+		}
+		planes[0] = row[3] + row[0];
+		planes[1] = row[3] - row[0];
+		planes[2] = row[3] + row[1];
+		planes[3] = row[3] - row[1];
+		planes[4] = row[3] + row[2];
+		planes[5] = row[3] - row[2];
+		// Normalise so sphere tests can use distances directly
+		for (auto& p : planes) {
+			p /= glm::length(glm::vec3(p.x, p.y, p.z));
+		}
+	}
+
+	// Whether any part of the axis aligned box may be visible
+	bool intersects(const glm::vec3& box_min, const glm::vec3& box_max) const
+	{
+		for (auto& p : planes) {
+			// Test the corner furthest along the plane normal
+			glm::vec3 corner(p.x >= 0.0f ? box_max.x : box_min.x,
+				p.y >= 0.0f ? box_max.y : box_min.y,
+				p.z >= 0.0f ? box_max.z : box_min.z);
+			if (glm::dot(glm::vec3(p.x, p.y, p.z), corner) + p.w < 0.0f) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Whether any part of the sphere may be visible
+	bool intersects(const glm::vec3& centre, float radius) const
+	{
+		for (auto& p : planes) {
+			if (glm::dot(glm::vec3(p.x, p.y, p.z), centre) + p.w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
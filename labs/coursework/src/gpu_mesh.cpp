@@ -0,0 +1,360 @@
+#include "gpu_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include "frustum.h"
+#include "mesh_tools.h"
+
+using namespace std;
+using namespace graphics_framework;
+using namespace glm;
+
+namespace
+{
+	// One vertex attribute ready for upload, in the form the GPU reads it
+	struct attribute
+	{
+		GLuint index;
+		GLint components;
+		GLenum type;
+		GLboolean normalised;
+		// Bytes per vertex
+		size_t size;
+		vector<uint8_t> data;
+		// Where it ends up once uploaded
+		GLuint buffer = 0;
+		size_t offset = 0;
+		GLsizei stride = 0;
+	};
+
+	template <typename T>
+	attribute make_attribute(GLuint index, GLint components, GLenum type, GLboolean normalised, const T* values,
+		size_t count)
+	{
+		attribute a = { index, components, type, normalised, sizeof(T), vector<uint8_t>(count * sizeof(T)) };
+		memcpy(a.data.data(), values, a.data.size());
+		return a;
+	}
+
+	// Creates a buffer holding the attributes, each vertex's together when interleaving and
+	// each attribute's stream after the last otherwise, and points each attribute into it
+	void upload_buffer(GLuint& buffer, vector<attribute*> attributes, bool interleave, size_t vertex_count)
+	{
+		size_t vertex_size = 0;
+		for (auto a : attributes) {
+			vertex_size += a->size;
+		}
+		vector<uint8_t> data(vertex_size * vertex_count);
+		size_t offset = 0;
+		for (auto a : attributes) {
+			if (interleave) {
+				for (size_t v = 0; v < vertex_count; ++v) {
+					memcpy(&data[v * vertex_size + offset], &a->data[v * a->size], a->size);
+				}
+				a->offset = offset;
+				a->stride = static_cast<GLsizei>(vertex_size);
+				offset += a->size;
+			} else {
+				memcpy(&data[offset], a->data.data(), a->data.size());
+				a->offset = offset;
+				a->stride = static_cast<GLsizei>(a->size);
+				offset += a->data.size();
+			}
+		}
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+		for (auto a : attributes) {
+			a->buffer = buffer;
+		}
+	}
+
+	void set_attribute(const attribute& a)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, a.buffer);
+		glEnableVertexAttribArray(a.index);
+		glVertexAttribPointer(a.index, a.components, a.type, a.normalised, a.stride, (void*)a.offset);
+	}
+
+	// Creates the index buffer and the vertex arrays reading every attribute and positions alone
+	void create_vertex_arrays(GLuint& vao, GLuint& position_vao, GLuint& index_buffer, const attribute& position,
+		const attribute& normal, const attribute& tex_coord, size_t index_count, const uint32_t* indices)
+	{
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		set_attribute(position);
+		set_attribute(normal);
+		set_attribute(tex_coord);
+
+		glGenBuffers(1, &index_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+		// Positions alone over the same buffers
+		glGenVertexArrays(1, &position_vao);
+		glBindVertexArray(position_vao);
+		set_attribute(position);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		glBindVertexArray(0);
+	}
+}
+
+gpu_mesh::gpu_mesh(const cached_mesh& source, vertex_layout layout, vertex_format format)
+	: _layout(layout), _format(format), _lods(source.lods()), _clusters(source.clusters()),
+	  _bounds_min(source.bounds_min()), _bounds_max(source.bounds_max())
+{
+	if (!source.is_packed()) {
+		upload(source.vertex_count(), source.positions(), source.normals(), source.tex_coords(),
+			source.index_count(), source.indices());
+		return;
+	}
+	// Packed streams go to the GPU straight from the cache
+	if (layout != vertex_layout::split || format != vertex_format::packed) {
+		throw runtime_error("A packed mesh cache only uploads in the split layout and packed format");
+	}
+	_position_transform =
+		translate(mat4(1.0f), _bounds_min) * scale(mat4(1.0f), packed_extent(_bounds_min, _bounds_max));
+	upload_packed(source.vertex_count(), source.packed_positions(), source.attributes(), source.index_count(),
+		source.indices());
+}
+
+gpu_mesh::gpu_mesh(const obj_data& source, vertex_layout layout, vertex_format format)
+	: _layout(layout), _format(format), _lods(source.lods), _clusters(source.clusters)
+{
+	if (_lods.empty()) {
+		_lods.push_back({ 0, static_cast<uint32_t>(source.indices.size()), 0.0f });
+	}
+	if (!source.positions.empty()) {
+		_bounds_min = _bounds_max = source.positions[0];
+		for (auto& p : source.positions) {
+			_bounds_min = min(_bounds_min, p);
+			_bounds_max = max(_bounds_max, p);
+		}
+	}
+	upload(source.positions.size(), source.positions.data(), source.normals.data(), source.tex_coords.data(),
+		source.indices.size(), source.indices.data());
+}
+
+gpu_mesh::gpu_mesh(const static_mesh_view& source, const vec3& dims)
+	: _layout(vertex_layout::split), _format(vertex_format::packed)
+{
+	_lods.push_back({ 0, static_cast<uint32_t>(source.index_count), 0.0f });
+	// The positions are fractions of the bounds, so scaling the bounds scales the
+	// mesh; a negative scale mirrors it and leaves low above high
+	auto low = vec3(source.bounds_min[0], source.bounds_min[1], source.bounds_min[2]) * dims;
+	auto high = vec3(source.bounds_max[0], source.bounds_max[1], source.bounds_max[2]) * dims;
+	_bounds_min = min(low, high);
+	_bounds_max = max(low, high);
+	auto extent = high - low;
+	for (int c = 0; c < 3; ++c) {
+		extent[c] = extent[c] != 0.0f ? extent[c] : 1.0f;
+	}
+	_position_transform = translate(mat4(1.0f), low) * scale(mat4(1.0f), extent);
+	upload_packed(source.vertex_count, source.positions, source.attributes, source.index_count, source.indices);
+}
+
+void gpu_mesh::upload(size_t vertex_count, const vec3* positions, const vec3* normals, const vec2* tex_coords,
+	size_t index_count, const uint32_t* indices)
+{
+	attribute position, normal, tex_coord;
+	if (_format == vertex_format::full) {
+		position = make_attribute(BUFFER_INDEXES::POSITION_BUFFER, 3, GL_FLOAT, GL_FALSE, positions, vertex_count);
+		normal = make_attribute(BUFFER_INDEXES::NORMAL_BUFFER, 3, GL_FLOAT, GL_FALSE, normals, vertex_count);
+		tex_coord = make_attribute(BUFFER_INDEXES::TEXTURE_COORDS_0, 2, GL_FLOAT, GL_FALSE, tex_coords, vertex_count);
+		_position_transform = mat4(1.0f);
+	} else {
+		auto extent = packed_extent(_bounds_min, _bounds_max);
+		_position_transform = translate(mat4(1.0f), _bounds_min) * scale(mat4(1.0f), extent);
+		vector<uint16_t> quantised(vertex_count * 4);
+		vector<packed_attributes> packed(vertex_count);
+		pack_vertices(vertex_count, positions, normals, tex_coords, _bounds_min, _bounds_max, quantised.data(),
+			packed.data());
+		if (_layout == vertex_layout::split) {
+			// Already laid out as the split buffers take them
+			upload_packed(vertex_count, quantised.data(), packed.data(), index_count, indices);
+			return;
+		}
+		vector<array<int16_t, 2>> octahedral(vertex_count);
+		vector<array<uint16_t, 2>> halves(vertex_count);
+		for (size_t i = 0; i < vertex_count; ++i) {
+			octahedral[i] = { { packed[i].normal[0], packed[i].normal[1] } };
+			halves[i] = { { packed[i].tex_coord[0], packed[i].tex_coord[1] } };
+		}
+		position = make_attribute(BUFFER_INDEXES::POSITION_BUFFER, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+			reinterpret_cast<const array<uint16_t, 4>*>(quantised.data()), vertex_count);
+		normal = make_attribute(BUFFER_INDEXES::NORMAL_BUFFER, 2, GL_SHORT, GL_TRUE, octahedral.data(), vertex_count);
+		tex_coord = make_attribute(BUFFER_INDEXES::TEXTURE_COORDS_0, 2, GL_HALF_FLOAT, GL_FALSE, halves.data(),
+			vertex_count);
+	}
+
+	switch (_layout) {
+	case vertex_layout::streams:
+		upload_buffer(_vertex_buffer, { &position, &normal, &tex_coord }, false, vertex_count);
+		_position_buffer = _vertex_buffer;
+		break;
+	case vertex_layout::interleaved:
+		upload_buffer(_vertex_buffer, { &position, &normal, &tex_coord }, true, vertex_count);
+		_position_buffer = _vertex_buffer;
+		break;
+	case vertex_layout::split:
+		upload_buffer(_position_buffer, { &position }, false, vertex_count);
+		upload_buffer(_vertex_buffer, { &normal, &tex_coord }, true, vertex_count);
+		break;
+	}
+	create_vertex_arrays(_vao, _position_vao, _index_buffer, position, normal, tex_coord, index_count, indices);
+}
+
+void gpu_mesh::upload_packed(size_t vertex_count, const void* positions, const void* attributes, size_t index_count,
+	const uint32_t* indices)
+{
+	// The layout upload_buffer gives a packed split mesh, without the copies
+	attribute position = { BUFFER_INDEXES::POSITION_BUFFER, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(uint16_t), {} };
+	attribute normal = { BUFFER_INDEXES::NORMAL_BUFFER, 2, GL_SHORT, GL_TRUE, 2 * sizeof(int16_t), {} };
+	attribute tex_coord = { BUFFER_INDEXES::TEXTURE_COORDS_0, 2, GL_HALF_FLOAT, GL_FALSE, 2 * sizeof(uint16_t), {} };
+	glGenBuffers(1, &_position_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _position_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertex_count * position.size, positions, GL_STATIC_DRAW);
+	glGenBuffers(1, &_vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(packed_attributes), attributes, GL_STATIC_DRAW);
+	position.buffer = _position_buffer;
+	position.stride = static_cast<GLsizei>(position.size);
+	normal.buffer = tex_coord.buffer = _vertex_buffer;
+	normal.stride = tex_coord.stride = static_cast<GLsizei>(sizeof(packed_attributes));
+	tex_coord.offset = offsetof(packed_attributes, tex_coord);
+	create_vertex_arrays(_vao, _position_vao, _index_buffer, position, normal, tex_coord, index_count, indices);
+}
+
+void gpu_mesh::draw(GLuint vao, size_t level) const
+{
+	if (level >= _lods.size()) {
+		return;
+	}
+	auto& lod = _lods[level];
+	glBindVertexArray(vao);
+	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(lod.count), GL_UNSIGNED_INT,
+		(void*)(lod.first * sizeof(GLuint)));
+	glBindVertexArray(0);
+}
+
+void gpu_mesh::keep(uint32_t first, uint32_t count)
+{
+	if (!_draw_counts.empty() &&
+		reinterpret_cast<uintptr_t>(_draw_offsets.back()) / sizeof(GLuint) + _draw_counts.back() == first) {
+		_draw_counts.back() += static_cast<GLsizei>(count);
+		return;
+	}
+	_draw_counts.push_back(static_cast<GLsizei>(count));
+	_draw_offsets.push_back(reinterpret_cast<const void*>(static_cast<uintptr_t>(first) * sizeof(GLuint)));
+}
+
+size_t gpu_mesh::cull(size_t level, const mat4& clip, const vec3* eye)
+{
+	_draw_counts.clear();
+	_draw_offsets.clear();
+	if (level >= _lods.size()) {
+		return 0;
+	}
+	auto& lod = _lods[level];
+	frustum view(clip);
+	if (!view.intersects(_bounds_min, _bounds_max)) {
+		return 0;
+	}
+	if (_clusters.empty()) {
+		keep(lod.first, lod.count);
+		return lod.count / 3;
+	}
+
+	// The level's clusters lie in its index range, in index order
+	auto begin = lower_bound(_clusters.begin(), _clusters.end(), lod.first,
+		[](const mesh_cluster& c, uint32_t first) { return c.first < first; });
+	size_t kept = 0;
+	for (auto c = begin; c != _clusters.end() && c->first < lod.first + lod.count; ++c) {
+		if (!view.intersects(c->centre, c->radius) || (eye && cluster_faces_away(*c, *eye))) {
+			continue;
+		}
+		keep(c->first, c->count);
+		kept += c->count / 3;
+	}
+	return kept;
+}
+
+void gpu_mesh::draw_visible(GLuint vao) const
+{
+	if (_draw_counts.empty()) {
+		return;
+	}
+	glBindVertexArray(vao);
+	glMultiDrawElements(GL_TRIANGLES, _draw_counts.data(), GL_UNSIGNED_INT, _draw_offsets.data(),
+		static_cast<GLsizei>(_draw_counts.size()));
+	glBindVertexArray(0);
+}
+
+size_t gpu_mesh::select_lod(float pixels_per_unit, float max_pixels) const
+{
+	// Errors only grow down the chain, so the first level too coarse ends the search
+	size_t level = 0;
+	while (level + 1 < _lods.size() && _lods[level + 1].error * pixels_per_unit <= max_pixels) {
+		++level;
+	}
+	return level;
+}
+
+obj_data read_geometry(const geometry& geom)
+{
+	if (geom.get_type() != GL_TRIANGLES && geom.get_type() != GL_TRIANGLE_STRIP) {
+		throw runtime_error("Only triangle geometry can be read back");
+	}
+	obj_data mesh;
+	auto count = geom.get_vertex_count();
+	mesh.positions.resize(count);
+	mesh.normals.assign(count, vec3(0.0f));
+	mesh.tex_coords.assign(count, vec2(0.0f));
+
+	// A buffer the geometry does not have reads as zero
+	auto read = [](GLuint buffer, GLenum target, size_t size, void* out) {
+		if (buffer != 0) {
+			glBindBuffer(target, buffer);
+			glGetBufferSubData(target, 0, size, out);
+			glBindBuffer(target, 0);
+		}
+	};
+	read(geom.get_buffer(BUFFER_INDEXES::POSITION_BUFFER), GL_ARRAY_BUFFER, count * sizeof(vec3),
+		mesh.positions.data());
+	read(geom.get_buffer(BUFFER_INDEXES::NORMAL_BUFFER), GL_ARRAY_BUFFER, count * sizeof(vec3), mesh.normals.data());
+	read(geom.get_buffer(BUFFER_INDEXES::TEXTURE_COORDS_0), GL_ARRAY_BUFFER, count * sizeof(vec2),
+		mesh.tex_coords.data());
+
+	// Vertex order when there is no index buffer
+	vector<uint32_t> order(geom.get_index_buffer() != 0 ? geom.get_index_count() : count);
+	if (geom.get_index_buffer() != 0) {
+		// The element binding belongs to the vertex array, so read through a copy target
+		read(geom.get_index_buffer(), GL_COPY_READ_BUFFER, order.size() * sizeof(GLuint), order.data());
+	} else {
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = static_cast<uint32_t>(i);
+		}
+	}
+
+	if (geom.get_type() == GL_TRIANGLES) {
+		mesh.indices = move(order);
+	} else {
+		// Every other triangle of a strip is wound the other way; the degenerate
+		// ones joining strips are dropped
+		for (size_t i = 2; i < order.size(); ++i) {
+			if (order[i - 2] == order[i - 1] || order[i - 1] == order[i] || order[i - 2] == order[i]) {
+				continue;
+			}
+			if (i % 2 == 0) {
+				mesh.indices.insert(mesh.indices.end(), { order[i - 2], order[i - 1], order[i] });
+			} else {
+				mesh.indices.insert(mesh.indices.end(), { order[i - 1], order[i - 2], order[i] });
+			}
+		}
+	}
+	return mesh;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <graphics_framework.h>
+
+#include "mesh_cache.h"
+#include "static_primitives.h"
+#include "vertex_packing.h"
+
+// A mesh on the GPU in its own buffers, uploaded from a cached mesh's streams,
+// from a mesh in memory or from one packed at compile time.  It draws with the
+// framework's attribute locations, so any effect written for a geometry works
+// with a full precision one; packed meshes need a vertex shader that decodes
+// their normals (packed.vert).  Every level of detail shares the one index
+// buffer, and a clustered mesh can be culled a cluster at a time to draw only
+// what may be seen.
+class gpu_mesh
+{
+public:
+	// How the vertex attributes are laid out in memory
+	enum class vertex_layout
+	{
+		// One buffer holding each attribute's stream back to back, as in the cache
+		streams,
+		// One buffer of whole vertices, position, normal and texture coordinate
+		// together, so a vertex is fetched from one place
+		interleaved,
+		// Positions in a buffer of their own and the other attributes interleaved
+		// in a second, so depth only passes fetch nothing else
+		split
+	};
+
+	// How each vertex attribute is stored
+	enum class vertex_format
+	{
+		// 32-bit floats throughout, 32 bytes a vertex
+		full,
+		// 16 bytes a vertex: positions as 16-bit fractions of the bounding box,
+		// expanded by get_position_transform(); normals as two 16-bit octahedral
+		// coordinates; texture coordinates as half floats
+		packed
+	};
+
+private:
+	// GL objects, which live as long as the context like the framework's own
+	GLuint _vao = 0;
+	// Reads positions alone, for depth only passes
+	GLuint _position_vao = 0;
+	GLuint _vertex_buffer = 0;
+	// The same as _vertex_buffer unless positions are split out
+	GLuint _position_buffer = 0;
+	GLuint _index_buffer = 0;
+	vertex_layout _layout = vertex_layout::split;
+	vertex_format _format = vertex_format::full;
+	glm::mat4 _position_transform = glm::mat4(1.0f);
+	std::vector<mesh_lod> _lods;
+	std::vector<mesh_cluster> _clusters;
+	// Index ranges the last cull kept, for glMultiDrawElements
+	std::vector<GLsizei> _draw_counts;
+	std::vector<const void*> _draw_offsets;
+	glm::vec3 _bounds_min = glm::vec3(0.0f);
+	glm::vec3 _bounds_max = glm::vec3(0.0f);
+
+	// Creates the buffers in the mesh's layout from the three vertex streams and the index stream
+	void upload(size_t vertex_count, const glm::vec3* positions, const glm::vec3* normals,
+		const glm::vec2* tex_coords, size_t index_count, const uint32_t* indices);
+	// Creates the buffers of a mesh already packed, split by positions, straight from its data
+	void upload_packed(size_t vertex_count, const void* positions, const void* attributes, size_t index_count,
+		const uint32_t* indices);
+	// Draws a level through one of the vertex arrays
+	void draw(GLuint vao, size_t level) const;
+	// Draws the ranges the last cull kept through one of the vertex arrays
+	void draw_visible(GLuint vao) const;
+	// Adds an index range to the draw list, joining it to the last when they touch
+	void keep(uint32_t first, uint32_t count);
+
+public:
+	gpu_mesh() = default;
+	// Uploads the mesh; source can be closed afterwards
+	explicit gpu_mesh(const cached_mesh& source, vertex_layout layout = vertex_layout::split,
+		vertex_format format = vertex_format::full);
+	explicit gpu_mesh(const obj_data& source, vertex_layout layout = vertex_layout::split,
+		vertex_format format = vertex_format::full);
+	// Uploads a static primitive (static_primitives.h) from its read-only data
+	// without converting it, in the split layout and packed format, scaled by dims
+	explicit gpu_mesh(const static_mesh_view& source, const glm::vec3& dims = glm::vec3(1.0f));
+
+	// Draws a level of the mesh with the bound effect, 0 being the full mesh
+	void render(size_t level = 0) const { draw(_vao, level); }
+	// The same reading positions only; the other attributes are constant
+	void render_positions(size_t level = 0) const { draw(_position_vao, level); }
+
+	// Picks what may be seen of a level through clip, which takes model space
+	// (before get_position_transform) to clip space, a cluster at a time when
+	// the mesh has clusters and as a whole when not.  Given the eye in model
+	// space, clusters facing wholly away from it are dropped too, for passes
+	// culling back faces.  Returns the triangles kept.
+	size_t cull(size_t level, const glm::mat4& clip, const glm::vec3* eye = nullptr);
+	// Draw what the last cull kept in one multi-draw
+	void render_visible() const { draw_visible(_vao); }
+	void render_visible_positions() const { draw_visible(_position_vao); }
+
+	size_t get_lod_count() const { return _lods.size(); }
+	size_t get_cluster_count() const { return _clusters.size(); }
+	// Index ranges the last cull left to draw
+	size_t get_drawn_ranges() const { return _draw_counts.size(); }
+	// Coarsest level whose error covers no more than max_pixels on screen when
+	// one unit of the mesh covers pixels_per_unit pixels
+	size_t select_lod(float pixels_per_unit, float max_pixels = 1.0f) const;
+
+	vertex_layout get_layout() const { return _layout; }
+	vertex_format get_format() const { return _format; }
+	// Takes the positions the GPU reads to model space; goes to the right of the model matrix
+	const glm::mat4& get_position_transform() const { return _position_transform; }
+	// Bounding box of the positions
+	const glm::vec3& get_bounds_min() const { return _bounds_min; }
+	const glm::vec3& get_bounds_max() const { return _bounds_max; }
+};
+
+// Reads a triangle geometry's positions, normals, texture coordinates and
+// indices back from the GPU, so meshes the framework builds can be processed
+// like loaded ones.  Strips are unrolled into lists; missing normals or texture
+// coordinates come back as zero.
+obj_data read_geometry(const graphics_framework::geometry& geom);
@@ -0,0 +1,287 @@
+#include "heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+heightfield::heightfield(heightmap heights, unsigned int width, unsigned int depth, float height_scale)
+	: _heights(move(heights)), _map_width(_heights.get_width()), _map_height(_heights.get_height())
+{
+	if (_map_width < 2 || _map_height < 2) {
+		throw runtime_error("A height field needs at least 2x2 samples");
+	}
+
+	// Level 0 - the range of the four samples of each cell
+	level base;
+	base.width = _map_width - 1;
+	base.height = _map_height - 1;
+	base.lowest.resize(static_cast<size_t>(base.width) * base.height);
+	base.highest.resize(base.lowest.size());
+	auto data = _heights.data();
+	for (unsigned int z = 0; z < base.height; ++z) {
+		auto row = data + static_cast<size_t>(z) * _map_width;
+		auto next = row + _map_width;
+		for (unsigned int x = 0; x < base.width; ++x) {
+			auto i = static_cast<size_t>(z) * base.width + x;
+			base.lowest[i] = std::min(std::min(row[x], row[x + 1]), std::min(next[x], next[x + 1]));
+			base.highest[i] = std::max(std::max(row[x], row[x + 1]), std::max(next[x], next[x + 1]));
+		}
+	}
+	setup(width, depth, height_scale, move(base));
+}
+
+heightfield::heightfield(const tiled_heightfield& tiles, unsigned int width, unsigned int depth, float height_scale)
+	: _tiles(&tiles), _map_width(tiles.get_width()), _map_height(tiles.get_height()), _block(tiles.get_tile_cells())
+{
+	if (_map_width < 2 || _map_height < 2) {
+		throw runtime_error("A height field needs at least 2x2 samples");
+	}
+
+	// Level 0 - a tile's range covers every sample of its cells, so it bounds them
+	level base;
+	base.width = tiles.get_tiles_x();
+	base.height = tiles.get_tiles_z();
+	base.lowest.resize(static_cast<size_t>(base.width) * base.height);
+	base.highest.resize(base.lowest.size());
+	for (unsigned int z = 0; z < base.height; ++z) {
+		for (unsigned int x = 0; x < base.width; ++x) {
+			auto i = static_cast<size_t>(z) * base.width + x;
+			tiles.get_tile_range(x, z, base.lowest[i], base.highest[i]);
+		}
+	}
+	setup(width, depth, height_scale, move(base));
+}
+
+void heightfield::setup(unsigned int width, unsigned int depth, float height_scale, level base)
+{
+	_width = static_cast<float>(width);
+	_depth = static_cast<float>(depth);
+	_height_scale = height_scale;
+	// Same spacing as build_terrain
+	_width_point = _width / static_cast<float>(_map_width);
+	_depth_point = _depth / static_cast<float>(_map_height);
+	_levels.push_back(move(base));
+
+	// Each level above halves the one below, down to a single entry
+	while (_levels.back().width > 1 || _levels.back().height > 1) {
+		auto& below = _levels.back();
+		level above;
+		above.width = (below.width + 1) / 2;
+		above.height = (below.height + 1) / 2;
+		above.lowest.assign(static_cast<size_t>(above.width) * above.height, 0xffff);
+		above.highest.assign(above.lowest.size(), 0);
+		for (unsigned int z = 0; z < below.height; ++z) {
+			for (unsigned int x = 0; x < below.width; ++x) {
+				auto from = static_cast<size_t>(z) * below.width + x;
+				auto to = static_cast<size_t>(z / 2) * above.width + x / 2;
+				above.lowest[to] = std::min(above.lowest[to], below.lowest[from]);
+				above.highest[to] = std::max(above.highest[to], below.highest[from]);
+			}
+		}
+		_levels.push_back(move(above));
+	}
+}
+
+vec2 heightfield::to_sample(float x, float z) const
+{
+	auto sx = (x + _width / 2.0f) / _width_point;
+	auto sz = (z + _depth / 2.0f) / _depth_point;
+	return vec2(std::min(std::max(sx, 0.0f), static_cast<float>(_map_width - 1)),
+		std::min(std::max(sz, 0.0f), static_cast<float>(_map_height - 1)));
+}
+
+float heightfield::height_at(float x, float z) const
+{
+	auto s = to_sample(x, z);
+	// The cell the point is in, using the last cell for points on the far edges
+	auto x0 = std::min(static_cast<unsigned int>(s.x), _map_width - 2);
+	auto z0 = std::min(static_cast<unsigned int>(s.y), _map_height - 2);
+	auto fx = s.x - x0;
+	auto fz = s.y - z0;
+	auto near_row = mix(get(x0, z0), get(x0 + 1, z0), fx);
+	auto far_row = mix(get(x0, z0 + 1), get(x0 + 1, z0 + 1), fx);
+	return mix(near_row, far_row, fz) * _height_scale;
+}
+
+vec3 heightfield::normal_at(float x, float z) const
+{
+	auto s = to_sample(x, z);
+	auto x0 = std::min(static_cast<unsigned int>(s.x), _map_width - 2);
+	auto z0 = std::min(static_cast<unsigned int>(s.y), _map_height - 2);
+	auto fx = s.x - x0;
+	auto fz = s.y - z0;
+	auto h00 = get(x0, z0), h10 = get(x0 + 1, z0);
+	auto h01 = get(x0, z0 + 1), h11 = get(x0 + 1, z0 + 1);
+	// Slopes of the bilinear patch at the point
+	auto dx = mix(h10 - h00, h11 - h01, fz) * _height_scale / _width_point;
+	auto dz = mix(h01 - h00, h11 - h10, fx) * _height_scale / _depth_point;
+	return normalize(vec3(-dx, 1.0f, -dz));
+}
+
+bool heightfield::raycast_cell(const vec3& origin, const vec3& dir, unsigned int x, unsigned int z, float& t) const
+{
+	auto position = [&](unsigned int px, unsigned int pz) {
+		return vec3(-(_width / 2.0f) + _width_point * px, get(px, pz) * _height_scale,
+			-(_depth / 2.0f) + _depth_point * pz);
+	};
+	auto p00 = position(x, z), p01 = position(x, z + 1), p11 = position(x + 1, z + 1), p10 = position(x + 1, z);
+
+	// Moller-Trumbore against the same two triangles terrain_lod draws for the cell
+	auto triangle = [&](const vec3& a, const vec3& b, const vec3& c) {
+		auto e1 = b - a;
+		auto e2 = c - a;
+		auto p = cross(dir, e2);
+		auto det = dot(e1, p);
+		if (abs(det) < 1e-12f) {
+			return false;
+		}
+		auto inv = 1.0f / det;
+		auto s = origin - a;
+		auto u = dot(s, p) * inv;
+		if (u < 0.0f || u > 1.0f) {
+			return false;
+		}
+		auto q = cross(s, e1);
+		auto v = dot(dir, q) * inv;
+		if (v < 0.0f || u + v > 1.0f) {
+			return false;
+		}
+		auto hit = dot(e2, q) * inv;
+		if (hit < 0.0f || hit >= t) {
+			return false;
+		}
+		t = hit;
+		return true;
+	};
+	auto first = triangle(p00, p01, p11);
+	auto second = triangle(p00, p11, p10);
+	return first || second;
+}
+
+bool heightfield::raycast_block(const vec3& origin, const vec3& dir, unsigned int x0, unsigned int z0,
+	unsigned int x1, unsigned int z1, float enter, float leave, float& t) const
+{
+	// Cell the ray enters the block in
+	auto start = origin + dir * enter;
+	auto cell = [](float position, float spacing, unsigned int low, unsigned int high) {
+		auto c = static_cast<int>(std::floor(position / spacing));
+		return static_cast<unsigned int>(std::min(std::max(c, static_cast<int>(low)), static_cast<int>(high) - 1));
+	};
+	auto x = cell(start.x + _width / 2.0f, _width_point, x0, x1);
+	auto z = cell(start.z + _depth / 2.0f, _depth_point, z0, z1);
+
+	// 2D DDA: where the ray crosses the next cell edge along x and z, and how far
+	// apart those crossings are
+	const auto never = numeric_limits<float>::max();
+	auto edge = [](float low, float spacing, unsigned int c, float o, float d) {
+		return (low + spacing * (c + (d > 0.0f ? 1 : 0)) - o) / d;
+	};
+	auto next_x = dir.x != 0.0f ? edge(-(_width / 2.0f), _width_point, x, origin.x, dir.x) : never;
+	auto next_z = dir.z != 0.0f ? edge(-(_depth / 2.0f), _depth_point, z, origin.z, dir.z) : never;
+	auto step_x = dir.x != 0.0f ? _width_point / abs(dir.x) : never;
+	auto step_z = dir.z != 0.0f ? _depth_point / abs(dir.z) : never;
+
+	// Cells come in the order the ray crosses them, so the first hit is the nearest
+	while (true) {
+		if (raycast_cell(origin, dir, x, z, t)) {
+			return true;
+		}
+		auto crossing = std::min(next_x, next_z);
+		if (crossing > leave || crossing >= t) {
+			return false;
+		}
+		if (next_x < next_z) {
+			x = dir.x > 0.0f ? x + 1 : x - 1;
+			next_x += step_x;
+			if (x < x0 || x >= x1) {
+				return false;
+			}
+		} else {
+			z = dir.z > 0.0f ? z + 1 : z - 1;
+			next_z += step_z;
+			if (z < z0 || z >= z1) {
+				return false;
+			}
+		}
+	}
+}
+
+bool heightfield::raycast(const vec3& origin, const vec3& dir, float max_distance, float& t) const
+{
+	if (_levels.empty()) {
+		return false;
+	}
+	auto best = max_distance;
+	auto hit = false;
+
+	// Visit the pyramid front to back: children nearer the ray's start along x
+	// and z are pushed last so they are popped first, like a 2D DDA walk that
+	// steps over whole blocks the ray clears
+	unsigned int near_x = dir.x >= 0.0f ? 0 : 1;
+	unsigned int near_z = dir.z >= 0.0f ? 0 : 1;
+	struct item
+	{
+		unsigned int level, x, z;
+	};
+	item stack[128];
+	int top = 0;
+	stack[top++] = { static_cast<unsigned int>(_levels.size()) - 1, 0, 0 };
+	auto cells_x = _map_width - 1;
+	auto cells_z = _map_height - 1;
+
+	while (top > 0) {
+		auto node = stack[--top];
+		auto& lv = _levels[node.level];
+		auto i = static_cast<size_t>(node.z) * lv.width + node.x;
+
+		// Box of the block: its cells along x and z, its height range along y
+		auto x0 = (node.x << node.level) * _block, x1 = std::min(((node.x + 1) << node.level) * _block, cells_x);
+		auto z0 = (node.z << node.level) * _block, z1 = std::min(((node.z + 1) << node.level) * _block, cells_z);
+		vec3 box_min(-(_width / 2.0f) + _width_point * x0, lv.lowest[i] / 65535.0f * _height_scale,
+			-(_depth / 2.0f) + _depth_point * z0);
+		vec3 box_max(-(_width / 2.0f) + _width_point * x1, lv.highest[i] / 65535.0f * _height_scale,
+			-(_depth / 2.0f) + _depth_point * z1);
+
+		// Slab test, keeping only blocks entered before the best hit so far
+		auto enter = 0.0f, leave = best;
+		auto inside = true;
+		for (int axis = 0; axis < 3 && inside; ++axis) {
+			if (dir[axis] == 0.0f) {
+				inside = origin[axis] >= box_min[axis] && origin[axis] <= box_max[axis];
+				continue;
+			}
+			auto t0 = (box_min[axis] - origin[axis]) / dir[axis];
+			auto t1 = (box_max[axis] - origin[axis]) / dir[axis];
+			enter = std::max(enter, std::min(t0, t1));
+			leave = std::min(leave, std::max(t0, t1));
+			inside = enter <= leave;
+		}
+		if (!inside) {
+			continue;
+		}
+
+		if (node.level == 0) {
+			hit |= raycast_block(origin, dir, x0, z0, x1, z1, enter, leave, best);
+			continue;
+		}
+
+		// Far children first; the middle two are never both crossed by one ray
+		auto& child_level = _levels[node.level - 1];
+		for (int order = 3; order >= 0; --order) {
+			auto cx = node.x * 2 + ((order & 1) ^ near_x);
+			auto cz = node.z * 2 + (((order >> 1) & 1) ^ near_z);
+			if (cx < child_level.width && cz < child_level.height) {
+				stack[top++] = { node.level - 1, cx, cz };
+			}
+		}
+	}
+
+	if (hit) {
+		t = best;
+	}
+	return hit;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "heightmap.h"
+#include "tiled_heightfield.h"
+
+// Answers height, normal and ray queries against a terrain in its own space,
+// laid out the same as build_terrain and terrain_lod (sample (0, 0) at
+// (-width / 2, -depth / 2)).  Points and rays in world space need the terrain's
+// inverse transform applied first.
+//
+// The samples are either a height map held in memory or a tiled height field
+// read in place, so queries against a streamed terrain page in only the tiles
+// they touch and keep just a coarse range table resident.
+class heightfield
+{
+private:
+	// Samples when held in memory
+	heightmap _heights;
+	// Samples when read from tiles, which outlive the heightfield
+	const tiled_heightfield* _tiles = nullptr;
+	// Map size in samples
+	unsigned int _map_width = 0;
+	unsigned int _map_height = 0;
+	float _width = 0.0f;
+	float _depth = 0.0f;
+	float _height_scale = 0.0f;
+	// Distance between samples
+	float _width_point = 0.0f;
+	float _depth_point = 0.0f;
+
+	// One level of the min/max pyramid; level 0 has an entry per block of
+	// _block x _block cells and each level above merges 2x2 entries of the one below
+	struct level
+	{
+		unsigned int width, height;
+		std::vector<uint16_t> lowest, highest;
+	};
+	std::vector<level> _levels;
+	// Cells along each side of a level 0 block: 1 for a map in memory, a tile for tiles
+	unsigned int _block = 1;
+
+	// Sets the spacing and builds the pyramid above level 0
+	void setup(unsigned int width, unsigned int depth, float height_scale, level base);
+	// Sample at (x, z), 0-65535
+	uint16_t sample(unsigned int x, unsigned int z) const
+	{
+		return _tiles ? _tiles->get_sample(x, z) : _heights.data()[static_cast<size_t>(z) * _map_width + x];
+	}
+	// Sample at (x, z) as a height in the range 0-1
+	float get(unsigned int x, unsigned int z) const { return sample(x, z) / 65535.0f; }
+	// Fractional sample coordinates of a terrain space point, clamped to the map
+	glm::vec2 to_sample(float x, float z) const;
+	// Tests the cells of the block [x0, x1) x [z0, z1) the ray crosses between
+	// enter and leave, nearest first, lowering t to the first hit
+	bool raycast_block(const glm::vec3& origin, const glm::vec3& dir, unsigned int x0, unsigned int z0,
+		unsigned int x1, unsigned int z1, float enter, float leave, float& t) const;
+
+public:
+	heightfield() = default;
+	// Takes the height map and builds the min/max pyramid
+	heightfield(heightmap heights, unsigned int width, unsigned int depth, float height_scale);
+	// Queries a tiled height field in place, building the pyramid from its tile
+	// range table; tiles must outlive the heightfield
+	heightfield(const tiled_heightfield& tiles, unsigned int width, unsigned int depth, float height_scale);
+
+	// Height of the terrain at (x, z), bilinear between the four samples around it.
+	// Points off the map take the height of the nearest edge.
+	float height_at(float x, float z) const;
+	// Normal of the bilinear surface at (x, z)
+	glm::vec3 normal_at(float x, float z) const;
+
+	// Finds where a ray first hits the terrain triangles within max_distance,
+	// setting t so the hit is origin + dir * t.  Whole blocks of cells the ray
+	// passes over are skipped using the min/max pyramid, and the cells of the
+	// blocks it enters are walked along the ray.
+	bool raycast(const glm::vec3& origin, const glm::vec3& dir, float max_distance, float& t) const;
+	// Tests a ray against the two triangles of cell (x, z) alone, lowering t to
+	// the hit when there is one nearer than t
+	bool raycast_cell(const glm::vec3& origin, const glm::vec3& dir, unsigned int x, unsigned int z, float& t) const;
+
+	// Map size in samples
+	unsigned int get_map_width() const { return _map_width; }
+	unsigned int get_map_height() const { return _map_height; }
+};
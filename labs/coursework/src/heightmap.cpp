@@ -0,0 +1,110 @@
+#include "heightmap.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "image.h"
+
+using namespace std;
+
+heightmap::heightmap(const string& filename)
+{
+	// Pick the loader from the extension
+	auto dot = filename.find_last_of('.');
+	auto ext = dot == string::npos ? string() : filename.substr(dot + 1);
+	transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext == "raw" || ext == "r16") {
+		load_raw(filename);
+	} else {
+		load_image(filename);
+	}
+}
+
+heightmap::heightmap(unsigned int width, unsigned int height, vector<uint16_t> samples)
+	: _width(width), _height(height), _samples(move(samples))
+{
+	if (_samples.size() != static_cast<size_t>(width) * height) {
+		throw invalid_argument("heightmap sample count does not match its dimensions");
+	}
+	_data = _samples.data();
+}
+
+heightmap heightmap::from_floats(unsigned int width, unsigned int height, const float* heights)
+{
+	vector<uint16_t> samples(static_cast<size_t>(width) * height);
+	for (size_t i = 0; i < samples.size(); ++i) {
+		auto h = min(max(heights[i], 0.0f), 1.0f);
+		samples[i] = static_cast<uint16_t>(lround(h * 65535.0f));
+	}
+	return heightmap(width, height, move(samples));
+}
+
+heightmap heightmap::view(unsigned int width, unsigned int height, const uint16_t* samples)
+{
+	heightmap map;
+	map._width = width;
+	map._height = height;
+	map._data = samples;
+	return map;
+}
+
+void heightmap::load_image(const string& filename)
+{
+	auto image = decode_image(filename);
+
+	// Colour maps keep their height in green, matching the old readback of .y
+	auto channels = image.channels;
+	auto channel = channels >= 3 ? 1 : 0;
+	_width = image.width;
+	_height = image.height;
+	_samples.resize(static_cast<size_t>(_width) * _height);
+	for (unsigned int z = 0; z < _height; ++z) {
+		// Images are stored top-down, flip to match GL
+		size_t row = static_cast<size_t>(_height - 1 - z) * _width;
+		auto out = &_samples[static_cast<size_t>(z) * _width];
+		if (image.channel_size == 2) {
+			auto in = reinterpret_cast<const uint16_t*>(image.pixels.data()) + row * channels + channel;
+			for (unsigned int x = 0; x < _width; ++x) {
+				out[x] = in[x * channels];
+			}
+		} else {
+			// Scale 0-255 to 0-65535 so v / 255 == (v * 257) / 65535
+			auto in = image.pixels.data() + row * channels + channel;
+			for (unsigned int x = 0; x < _width; ++x) {
+				out[x] = static_cast<uint16_t>(in[x * channels] * 257);
+			}
+		}
+	}
+	_data = _samples.data();
+}
+
+void heightmap::load_raw(const string& filename)
+{
+	_file = mapped_file(filename);
+
+	// Headerless files have to be square
+	auto count = _file.size() / sizeof(uint16_t);
+	auto side = static_cast<unsigned int>(lround(sqrt(static_cast<double>(count))));
+	if (count == 0 || _file.size() % sizeof(uint16_t) != 0 || static_cast<size_t>(side) * side != count) {
+		throw runtime_error("Raw height map " + filename + " is not a square 16-bit grid");
+	}
+	_width = side;
+	_height = side;
+
+	// Little endian hosts read straight from the mapping, others swap into a copy
+	const uint16_t probe = 1;
+	if (*reinterpret_cast<const uint8_t*>(&probe) == 1) {
+		_data = reinterpret_cast<const uint16_t*>(_file.data());
+	} else {
+		auto bytes = reinterpret_cast<const uint8_t*>(_file.data());
+		_samples.resize(count);
+		for (size_t i = 0; i < count; ++i) {
+			_samples[i] = static_cast<uint16_t>(bytes[i * 2] | (bytes[i * 2 + 1] << 8));
+		}
+		_file = mapped_file();
+		_data = _samples.data();
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// A single channel grid of 16-bit heights decoded on the CPU, so terrain can be
+// built without a GL context.  Image rows are flipped bottom-up, the same order a
+// GL texture read back with glGetTexImage gives; raw files are used as stored.
+class heightmap
+{
+private:
+	// Dimensions in samples
+	unsigned int _width = 0;
+	unsigned int _height = 0;
+	// Owned samples, used for decoded images
+	std::vector<uint16_t> _samples;
+	// Raw 16-bit files are read in place from the mapping
+	mapped_file _file;
+	// The samples in use, either _samples or the mapped file
+	const uint16_t* _data = nullptr;
+
+	// Decodes an 8 or 16-bit image, keeping the green channel of colour images
+	void load_image(const std::string& filename);
+	// Maps a headerless, square, little endian 16-bit file
+	void load_raw(const std::string& filename);
+
+public:
+	heightmap() = default;
+	// Loads a .png/.jpg/.tga (8 or 16-bit) or .raw/.r16 height map, throwing
+	// std::runtime_error if the file cannot be read
+	explicit heightmap(const std::string& filename);
+	// Takes ownership of row-major samples
+	heightmap(unsigned int width, unsigned int height, std::vector<uint16_t> samples);
+	// Quantises row-major heights in the range 0-1
+	static heightmap from_floats(unsigned int width, unsigned int height, const float* heights);
+	// Wraps row-major samples owned elsewhere, which must outlive the view
+	static heightmap view(unsigned int width, unsigned int height, const uint16_t* samples);
+
+	heightmap(heightmap&&) = default;
+	heightmap& operator=(heightmap&&) = default;
+
+	// Width in samples
+	unsigned int get_width() const { return _width; }
+	// Height (depth) in samples
+	unsigned int get_height() const { return _height; }
+	// Raw samples, row-major
+	const uint16_t* data() const { return _data; }
+	// Sample at (x, z) as a height in the range 0-1
+	float get(unsigned int x, unsigned int z) const
+	{
+		return static_cast<float>(_data[static_cast<size_t>(z) * _width + x]) / 65535.0f;
+	}
+};
@@ -0,0 +1,34 @@
+#include "image.h"
+
+#include <cstring>
+#include <stdexcept>
+
+// Private copy of the decoder so it cannot clash with one built into the framework
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+using namespace std;
+
+decoded_image decode_image(const string& filename, unsigned int channels, bool allow_wide)
+{
+	int width, height, file_channels;
+	auto wide = allow_wide && stbi_is_16_bit(filename.c_str()) != 0;
+	auto wanted = static_cast<int>(channels);
+	void* pixels = wide
+		? static_cast<void*>(stbi_load_16(filename.c_str(), &width, &height, &file_channels, wanted))
+		: static_cast<void*>(stbi_load(filename.c_str(), &width, &height, &file_channels, wanted));
+	if (!pixels) {
+		throw runtime_error("Could not load image " + filename + ": " + stbi_failure_reason());
+	}
+
+	decoded_image image;
+	image.width = static_cast<unsigned int>(width);
+	image.height = static_cast<unsigned int>(height);
+	image.channels = channels != 0 ? channels : static_cast<unsigned int>(file_channels);
+	image.channel_size = wide ? 2 : 1;
+	image.pixels.resize(static_cast<size_t>(width) * height * image.channels * image.channel_size);
+	memcpy(image.pixels.data(), pixels, image.pixels.size());
+	stbi_image_free(pixels);
+	return image;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Pixels of an image file decoded on the CPU, rows top-down as stored, so it
+// can be read on any thread and only the upload waits for a GL context
+struct decoded_image
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int channels = 0;
+	// Bytes a channel, 1 or 2
+	unsigned int channel_size = 1;
+	std::vector<uint8_t> pixels;
+};
+
+// Decodes a .png/.jpg/.tga/.bmp file with channels channels a pixel, or the
+// file's own count when 0.  16-bit files stay 16-bit when wide is allowed and
+// are reduced to 8 otherwise.  Throws std::runtime_error if it cannot be read.
+decoded_image decode_image(const std::string& filename, unsigned int channels = 0, bool allow_wide = true);
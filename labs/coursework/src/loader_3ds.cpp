@@ -0,0 +1,307 @@
+#include "loader_3ds.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+	// Chunks read; every other chunk is skipped whole.  Values are little endian.
+	const uint16_t main_chunk = 0x4d4d;
+	const uint16_t editor_chunk = 0x3d3d;
+	const uint16_t object_chunk = 0x4000;
+	const uint16_t triangle_mesh_chunk = 0x4100;
+	const uint16_t vertex_list_chunk = 0x4110;
+	const uint16_t face_list_chunk = 0x4120;
+	const uint16_t tex_coord_list_chunk = 0x4140;
+	// Id and length, the length counting these 6 bytes
+	const size_t chunk_header_size = 6;
+
+	static_assert(sizeof(vec3) == 3 * sizeof(float) && sizeof(vec2) == 2 * sizeof(float),
+		"Vertex lists are read straight into glm vectors");
+
+	// 3DS data in memory
+	class memory_source
+	{
+	private:
+		const char* _data;
+		size_t _size;
+		size_t _position = 0;
+
+	public:
+		memory_source(const char* data, size_t size) : _data(data), _size(size) {}
+
+		// Copies the next size bytes to out, returning false if there are not that many
+		bool read(void* out, size_t size)
+		{
+			if (size > _size - _position) {
+				return false;
+			}
+			memcpy(out, _data + _position, size);
+			_position += size;
+			return true;
+		}
+		void seek(size_t position) { _position = std::min(position, _size); }
+		size_t position() const { return _position; }
+		size_t size() const { return _size; }
+	};
+
+	// 3DS data read from a stream, seeking over what is not needed
+	class stream_source
+	{
+	private:
+		istream& _in;
+		// Where the data starts in the stream, so positions count from 0
+		istream::pos_type _start;
+		size_t _position = 0;
+		size_t _size;
+
+	public:
+		explicit stream_source(istream& in) : _in(in), _start(in.tellg())
+		{
+			_in.seekg(0, ios::end);
+			_size = static_cast<size_t>(_in.tellg() - _start);
+			_in.seekg(_start);
+			if (!_in) {
+				throw runtime_error("3DS data must come from a stream that can seek");
+			}
+		}
+
+		bool read(void* out, size_t size)
+		{
+			if (size > _size - _position || !_in.read(static_cast<char*>(out), size)) {
+				return false;
+			}
+			_position += size;
+			return true;
+		}
+		void seek(size_t position)
+		{
+			_position = std::min(position, _size);
+			_in.seekg(_start + static_cast<istream::off_type>(_position));
+		}
+		size_t position() const { return _position; }
+		size_t size() const { return _size; }
+	};
+
+	// Walks the chunk tree of one file, adding each triangle mesh to out
+	template <typename Source>
+	class reader_3ds
+	{
+	private:
+		Source& _source;
+		vector<object_3ds>& _out;
+		const string& _name;
+
+		void fail(const string& problem) const { throw runtime_error(_name + " " + problem); }
+
+		void read_bytes(void* out, size_t size)
+		{
+			if (!_source.read(out, size)) {
+				fail("ends in the middle of a chunk");
+			}
+		}
+
+		template <typename T>
+		T read_value()
+		{
+			T value;
+			read_bytes(&value, sizeof(value));
+			return value;
+		}
+
+		// Reads the header of the next chunk before end, returning false when there is none
+		bool next_chunk(size_t end, uint16_t& id, size_t& chunk_end)
+		{
+			auto start = _source.position();
+			if (start + chunk_header_size > end) {
+				return false;
+			}
+			id = read_value<uint16_t>();
+			auto length = read_value<uint32_t>();
+			if (length < chunk_header_size || length > end - start) {
+				fail("has a chunk running past its parent");
+			}
+			chunk_end = start + length;
+			return true;
+		}
+
+		// Count of a list chunk, checked against the bytes left in it
+		size_t read_count(size_t end, size_t item_size)
+		{
+			size_t count = read_value<uint16_t>();
+			if (count * item_size > end - _source.position()) {
+				fail("has a list longer than its chunk");
+			}
+			return count;
+		}
+
+		void read_mesh(size_t end, object_3ds& object)
+		{
+			auto& mesh = object.mesh;
+			uint16_t id;
+			size_t chunk_end;
+			while (next_chunk(end, id, chunk_end)) {
+				if (id == vertex_list_chunk) {
+					mesh.positions.resize(read_count(chunk_end, sizeof(vec3)));
+					read_bytes(mesh.positions.data(), mesh.positions.size() * sizeof(vec3));
+				} else if (id == tex_coord_list_chunk) {
+					mesh.tex_coords.resize(read_count(chunk_end, sizeof(vec2)));
+					read_bytes(mesh.tex_coords.data(), mesh.tex_coords.size() * sizeof(vec2));
+				} else if (id == face_list_chunk) {
+					// Three corners and a flags word a face, read a block at a time
+					// straight into the index list
+					auto faces = read_count(chunk_end, 4 * sizeof(uint16_t));
+					mesh.indices.resize(faces * 3);
+					uint16_t block[4 * 256];
+					for (size_t first = 0; first < faces; first += 256) {
+						auto count = std::min<size_t>(faces - first, 256);
+						read_bytes(block, count * 4 * sizeof(uint16_t));
+						for (size_t f = 0; f < count; ++f) {
+							copy(block + f * 4, block + f * 4 + 3, mesh.indices.begin() + (first + f) * 3);
+						}
+					}
+				}
+				// Material and smoothing group lists follow the faces in the same chunk
+				_source.seek(chunk_end);
+			}
+		}
+
+		void read_object(size_t end)
+		{
+			// The name runs to a nul, at most up to the end of the chunk
+			string name;
+			char c;
+			while (_source.position() < end && (c = read_value<char>()) != '\0') {
+				name += c;
+			}
+			uint16_t id;
+			size_t chunk_end;
+			while (next_chunk(end, id, chunk_end)) {
+				if (id == triangle_mesh_chunk) {
+					object_3ds object;
+					object.name = name;
+					read_mesh(chunk_end, object);
+					if (!object.mesh.indices.empty()) {
+						finish(object);
+						_out.push_back(move(object));
+					}
+				}
+				_source.seek(chunk_end);
+			}
+		}
+
+		// Checks the faces and fills in texture coordinates and normals
+		void finish(object_3ds& object)
+		{
+			auto& mesh = object.mesh;
+			auto vertices = mesh.positions.size();
+			for (auto index : mesh.indices) {
+				if (index >= vertices) {
+					fail("object " + object.name + " has a face using a missing vertex");
+				}
+			}
+			mesh.tex_coords.resize(vertices, vec2(0.0f));
+
+			// Area weighted normal of every face around each vertex
+			mesh.normals.assign(vertices, vec3(0.0f));
+			for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+				auto a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+				auto n = cross(mesh.positions[b] - mesh.positions[a], mesh.positions[c] - mesh.positions[a]);
+				mesh.normals[a] += n;
+				mesh.normals[b] += n;
+				mesh.normals[c] += n;
+			}
+			for (auto& n : mesh.normals) {
+				n = dot(n, n) > 0.0f ? normalize(n) : vec3(0.0f, 0.0f, 1.0f);
+			}
+		}
+
+	public:
+		reader_3ds(Source& source, vector<object_3ds>& out, const string& name)
+			: _source(source), _out(out), _name(name)
+		{
+		}
+
+		// Descends through the main and editor chunks to the objects
+		void read(size_t end)
+		{
+			uint16_t id;
+			size_t chunk_end;
+			while (next_chunk(end, id, chunk_end)) {
+				if (id == main_chunk || id == editor_chunk) {
+					read(chunk_end);
+				} else if (id == object_chunk) {
+					read_object(chunk_end);
+				}
+				_source.seek(chunk_end);
+			}
+		}
+	};
+
+	template <typename Source>
+	void read_3ds(Source& source, vector<object_3ds>& out, const string& name)
+	{
+		out.clear();
+		uint16_t id;
+		if (!source.read(&id, sizeof(id)) || id != main_chunk) {
+			throw runtime_error(name + " is not a 3DS file");
+		}
+		source.seek(0);
+		reader_3ds<Source>(source, out, name).read(source.size());
+	}
+}
+
+void load_3ds(const string& filename, vector<object_3ds>& out)
+{
+	ifstream file(filename, ios::binary);
+	if (!file) {
+		throw runtime_error("Could not open " + filename);
+	}
+	load_3ds(file, out, filename);
+}
+
+void load_3ds(istream& in, vector<object_3ds>& out, const string& name)
+{
+	stream_source source(in);
+	read_3ds(source, out, name);
+}
+
+void parse_3ds(const char* data, size_t size, vector<object_3ds>& out, const string& name)
+{
+	memory_source source(data, size);
+	read_3ds(source, out, name);
+}
+
+void parse_3ds(const char* data, size_t size, obj_data& out, const string& name)
+{
+	vector<object_3ds> objects;
+	parse_3ds(data, size, objects, name);
+
+	// Objects one after another, each indexing its own vertices
+	out = obj_data();
+	size_t vertices = 0, indices = 0;
+	for (auto& object : objects) {
+		vertices += object.mesh.positions.size();
+		indices += object.mesh.indices.size();
+	}
+	out.positions.reserve(vertices);
+	out.normals.reserve(vertices);
+	out.tex_coords.reserve(vertices);
+	out.indices.reserve(indices);
+	for (auto& object : objects) {
+		auto& mesh = object.mesh;
+		auto base = static_cast<uint32_t>(out.positions.size());
+		out.positions.insert(out.positions.end(), mesh.positions.begin(), mesh.positions.end());
+		out.normals.insert(out.normals.end(), mesh.normals.begin(), mesh.normals.end());
+		out.tex_coords.insert(out.tex_coords.end(), mesh.tex_coords.begin(), mesh.tex_coords.end());
+		for (auto index : mesh.indices) {
+			out.indices.push_back(base + index);
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "obj_loader.h"
+
+// One mesh object of a 3D Studio file, under the name the file gives it
+struct object_3ds
+{
+	std::string name;
+	obj_data mesh;
+};
+
+// Reads the mesh objects of a 3D Studio (.3ds) file a chunk at a time, seeking
+// past every chunk it has no use for, so the file is never held in memory.
+// Each object's vertex, texture coordinate and face lists are read straight
+// into buffers sized from their chunk headers.  Normals are smoothed from the
+// faces around each vertex (smoothing groups are not read), missing texture
+// coordinates are zero, and positions are left in the file's Z up space.
+// Objects without triangles, such as lights and cameras, are skipped.  Throws
+// std::runtime_error if the file cannot be opened or is malformed.
+void load_3ds(const std::string& filename, std::vector<object_3ds>& out);
+
+// The same from a stream, or from 3DS data already in memory such as a mapped
+// file; name is used in error messages
+void load_3ds(std::istream& in, std::vector<object_3ds>& out, const std::string& name = "3DS data");
+void parse_3ds(const char* data, size_t size, std::vector<object_3ds>& out, const std::string& name = "3DS data");
+
+// Parses 3DS data in memory into one mesh holding every object, in the form
+// cached_mesh::parser takes
+void parse_3ds(const char* data, size_t size, obj_data& out, const std::string& name = "3DS data");
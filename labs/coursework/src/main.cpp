@@ -1,6 +1,20 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
 
+#include <cstring>
+
+#include "asset_loader.h"
+#include "gpu_mesh.h"
+#include "heightfield.h"
+#include "heightmap.h"
+#include "image.h"
+#include "loader_3ds.h"
+#include "mesh_simplify.h"
+#include "mesh_tools.h"
+#include "primitive_cache.h"
+#include "terrain_lod.h"
+#include "tiled_heightfield.h"
+
 using namespace std;
 using namespace graphics_framework;
 using namespace glm;
@@ -11,129 +25,146 @@ spot_light spot;
 directional_light light;
 vector<point_light> points(3);
 map<string, mesh> meshes;
+// Welded and indexed models, drawn in place of the geometry of the mesh with the
+// same name; meshes made from the same primitive share one
+map<string, shared_ptr<gpu_mesh>> gpu_meshes;
+primitive_cache primitives;
 map<string, vec4> colours;
-map<string, texture> textures;
+// GL textures made by load_texture, living as long as the context
+map<string, GLuint> textures;
 map<string, material> materials;
 
 mesh skybox, terr;
+// Declared before terrain and terrain_query so it outlives the chunks streaming
+// from it and the queries reading it
+tiled_heightfield terrain_tiles;
+terrain_lod terrain;
+// Height and ray queries against the terrain, in its own space
+heightfield terrain_query;
 cubemap cube_map;
-texture terrain_tex;
+GLuint terrain_tex = 0;
 shadow_map shadow;
 
 frame_buffer frame;
 geometry screen_quad;
 
-void generate_terrain(geometry& geom, const texture& height_map,
-	unsigned int width, unsigned int depth, float height_scale)
+// Decodes files on worker threads and creates their GL objects a few at a time
+// between frames; the scene is drawn once it is empty
+asset_loader assets;
+// Milliseconds a frame may spend creating GL objects while loading
+const double upload_budget_ms = 8.0;
+
+// Loads an OBJ or 3DS model through the binary mesh cache, welding, optimising
+// and clustering it before it is cached as the "scene" pipeline in the packed
+// format, and uploads it as gpu_meshes[name] straight from the cache once it is
+// ready.  A 3DS file's objects become one mesh.
+void load_cached_model(const string& name, const string& filename)
 {
-	// Contains our position data
-	vector<vec3> positions;
-	// Contains our normal data
-	vector<vec3> normals;
-	// Contains our texture coordinate data
-	vector<vec2> tex_coords;
-	// Contains our index data
-	vector<unsigned int> indices;
-
-	// Extract the texture data from the image
-	glBindTexture(GL_TEXTURE_2D, height_map.get_id());
-	auto data = new vec4[height_map.get_width() * height_map.get_height()];
-	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, (void*)data);
-
-	// Determine ratio of height map to geometry
-	float width_point = static_cast<float>(width) / static_cast<float>(height_map.get_width());
-	float depth_point = static_cast<float>(depth) / static_cast<float>(height_map.get_height());
-
-	// Point to work on
-	vec3 point;
-
-	// Part 1 - Iterate through each point, calculate vertex and add to vector
-	for (int x = 0; x < height_map.get_width(); ++x) {
-		// Calculate x position of point
-		point.x = -(width / 2.0f) + (width_point * static_cast<float>(x));
-
-		for (int z = 0; z < height_map.get_height(); ++z) {
-			// *********************************
-			// Calculate z position of point
-			point.z = -(depth / 2.0f) + (depth_point * z);
-			// *********************************
-			// Y position based on red component of height map data
-			point.y = data[(z * height_map.get_width()) + x].y * height_scale;
-			// Add point to position data
-			positions.push_back(point);
-		}
-	}
+	auto is_3ds = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".3ds") == 0;
+	assets.load(
+		[filename, is_3ds]() {
+			return cached_mesh::open(filename, "scene", [&](const char* data, size_t size, obj_data& out) {
+				if (is_3ds) {
+					parse_3ds(data, size, out, filename);
+				} else {
+					parse_obj(data, size, out, thread_pool::shared(), filename);
+				}
+				weld_mesh(out);
+				optimise_mesh(out);
+				build_lod_chain(out);
+				build_clusters(out);
+			}, true);
+		},
+		[name](cached_mesh model) {
+			gpu_meshes[name] =
+				make_shared<gpu_mesh>(model, gpu_mesh::vertex_layout::split, gpu_mesh::vertex_format::packed);
+		});
+}
 
-	// Part 1 - Add index data
-	for (unsigned int x = 0; x < height_map.get_width() - 1; ++x) {
-		for (unsigned int y = 0; y < height_map.get_height() - 1; ++y) {
-			// Get four corners of patch
-			unsigned int top_left = (y * height_map.get_width()) + x;
-			unsigned int top_right = (y * height_map.get_width()) + x + 1;
-			// *********************************
-			unsigned int bottom_left = ((y + 1) * height_map.get_width()) + x;
-			unsigned int bottom_right = ((y + 1) * height_map.get_height()) + x + 1;
-			// *********************************
-			// Push back indices for triangle 1 (tl,br,bl)
-			indices.push_back(top_left);
-			indices.push_back(bottom_right);
-			indices.push_back(bottom_left);
-			// Push back indices for triangle 2 (tl,tr,br)
-			// *********************************
-			indices.push_back(top_left);
-			indices.push_back(top_right);
-			indices.push_back(bottom_right);
-			// *********************************
-		}
-	}
+// RGBA8 pixels of a texture decoded off the main thread
+struct texture_data
+{
+	unsigned int width, height;
+	vector<uint8_t> pixels;
+};
+
+// Decodes an image on a worker and makes it a mipmapped, anisotropic texture once
+// it is ready.  The framework's texture only takes floats, four times the bytes,
+// so the RGBA8 pixels go to GL as they are.
+void load_texture(const string& filename, GLuint& out)
+{
+	assets.load(
+		[filename]() {
+			auto image = decode_image(filename, 4, false);
+			texture_data data = { image.width, image.height, vector<uint8_t>(image.pixels.size()) };
+			// Rows go bottom-up, as GL reads them
+			size_t row = static_cast<size_t>(image.width) * 4;
+			for (unsigned int y = 0; y < image.height; ++y) {
+				memcpy(&data.pixels[y * row], &image.pixels[(image.height - 1 - y) * row], row);
+			}
+			return data;
+		},
+		[&out](texture_data data) {
+			glGenTextures(1, &out);
+			glBindTexture(GL_TEXTURE_2D, out);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+				data.pixels.data());
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			GLfloat max_anisotropy;
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, max_anisotropy);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		});
+}
 
-	// Resize the normals buffer
-	normals.resize(positions.size());
-
-	// Part 2 - Calculate normals for the height map
-	for (unsigned int i = 0; i < indices.size() / 3; ++i) {
-		// Get indices for the triangle
-		auto idx1 = indices[i * 3];
-		auto idx2 = indices[i * 3 + 1];
-		auto idx3 = indices[i * 3 + 2];
-
-		// Calculate two sides of the triangle
-		vec3 side1 = positions[idx1] - positions[idx3];
-		vec3 side2 = positions[idx1] - positions[idx2];
-
-		// Normal is normal(cross product) of these two sides
-		// *********************************
-		vec3 n = normalize(side2 * side1);
-
-		// Add to normals in the normal buffer using the indices for the triangle
-		normals[idx1] += n;
-		normals[idx2] += n;
-		normals[idx3] += n;
-		// *********************************
-	}
+// Binds a texture made by load_texture to a texture unit
+void bind_texture(GLuint id, int unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, id);
+}
 
-	// Normalize all the normals
-	for (auto& n : normals) {
-		// *********************************
-		n = normalize(n);
-		// *********************************
-	}
+// Model matrix of a mesh, first expanding its welded model's packed positions when it has one
+mat4 model_matrix(const string& name, const mesh& m)
+{
+	auto M = m.get_transform().get_transform_matrix();
+	auto cached = gpu_meshes.find(name);
+	return cached != gpu_meshes.end() ? M * cached->second->get_position_transform() : M;
+}
 
-	// Part 3 - Add texture coordinates for geometry
-	for (unsigned int x = 0; x < height_map.get_width(); ++x) {
-		for (unsigned int z = 0; z < height_map.get_height(); ++z) {
-			tex_coords.push_back(vec2(width_point * x, depth_point * z));
+// Draws a mesh, using its welded model in place of its geometry when it has one.
+// The model's level of detail is picked from the main camera in every pass, so
+// shadows are cast by the same triangles that are seen, and only its clusters
+// inside the pass's view (VP) are drawn.  Depth only passes read the model's
+// positions alone and cull front faces, so keep the clusters facing away.
+void render_mesh(const string& name, const mesh& m, const mat4& VP, bool depth_only = false)
+{
+	auto cached = gpu_meshes.find(name);
+	if (cached != gpu_meshes.end()) {
+		auto& model = *cached->second;
+		auto& t = m.get_transform();
+		auto scale = std::max(std::max(abs(t.scale.x), abs(t.scale.y)), abs(t.scale.z));
+		auto middle = (model.get_bounds_min() + model.get_bounds_max()) * 0.5f;
+		auto M = t.get_transform_matrix();
+		auto centre = vec3(M * vec4(middle, 1.0f));
+		auto radius = length(model.get_bounds_max() - model.get_bounds_min()) * 0.5f * scale;
+		// Pixels covered by one unit of the model at the nearest point of its bounding sphere
+		auto nearest = std::max(distance(cam.get_position(), centre) - radius, 0.1f);
+		auto pixels_per_unit = cam.get_projection()[1][1] * renderer::get_screen_height() * 0.5f / nearest * scale;
+		auto level = model.select_lod(pixels_per_unit);
+		if (depth_only) {
+			model.cull(level, VP * M);
+			model.render_visible_positions();
+		} else {
+			auto eye = vec3(inverse(M) * vec4(cam.get_position(), 1.0f));
+			model.cull(level, VP * M, &eye);
+			model.render_visible();
 		}
+	} else {
+		renderer::render(m);
 	}
-
-	// Add necessary buffers to the geometry
-	geom.add_buffer(positions, BUFFER_INDEXES::POSITION_BUFFER);
-	geom.add_buffer(normals, BUFFER_INDEXES::NORMAL_BUFFER);
-	geom.add_buffer(tex_coords, BUFFER_INDEXES::TEXTURE_COORDS_0);
-	geom.add_index_buffer(indices);
-
-	// Delete data
-	delete[] data;
 }
 
 bool load_content()
@@ -191,7 +222,8 @@ bool load_content()
 		"res/textures/redeclipse_rt.png", "res/textures/redeclipse_lf.png"
 	};
 
-	cube_map = cubemap(corona);
+	// The framework only builds cube maps from files, so this one loads on the main thread in its turn
+	assets.queue([corona]() { cube_map = cubemap(corona); });
 
 	// Define necessary colours
 	colours["black"] = vec4(0.0f, 0.0f, 0.0f, 1.0f);
@@ -202,33 +234,40 @@ bool load_content()
 	colours["blue"] = vec4(0.0f, 0.0f, 1.0f, 0.5f);
 
 	// Create or load each object and set properties
-	textures["pyramid"] = texture("res/textures/ground.jpg");
+	// Textures and models arrive over the first frames; framework geometry needs
+	// the context to build and read back, so it is welded on the main thread
+	load_texture("res/textures/ground.jpg", textures["pyramid"]);
 	materials["pyramid"] = material(colours["black"], colours["white"], colours["white"], 100.0f);
-	meshes["pyramid"] = mesh(geometry_builder::create_pyramid(vec3(5.0f, 5.0f, 5.0f)));
+	assets.queue([]() { gpu_meshes["pyramid"] = primitives.pyramid(vec3(5.0f, 5.0f, 5.0f)); });
+	meshes["pyramid"] = mesh();
 	meshes["pyramid"].get_transform().translate(vec3(0.0f, 2.5f, 0.0f));
 
-	textures["sphere"] = texture("res/textures/marble.jpg");
+	load_texture("res/textures/marble.jpg", textures["sphere"]);
 	materials["sphere"] = material(colours["black"], colours["white"], colours["white"], 10.0f);
-	meshes["sphere"] = mesh(geometry_builder::create_sphere(25, 25));
+	assets.queue([]() { gpu_meshes["sphere"] = primitives.sphere(25, 25); });
+	meshes["sphere"] = mesh();
 	meshes["sphere"].get_transform().scale = vec3(6.0f, 6.0f, 6.0f);
 	meshes["sphere"].get_transform().translate(vec3(0.0f, 12.0f, 0.0f));
 
-	textures["box"] = texture("res/textures/check_1.png");
+	load_texture("res/textures/check_1.png", textures["box"]);
 	materials["box"] = material(colours["black"], colours["white"], colours["white"], 20.0f);
-	meshes["box"] = mesh(geometry("res/models/box.obj"));
+	assets.queue([]() { gpu_meshes["box"] = make_shared<gpu_mesh>(weld_geometry(geometry("res/models/box.obj"))); });
+	meshes["box"] = mesh();
 	meshes["teapot"].get_transform().scale = vec3(2.0f, 2.0f, 2.0f);
 	meshes["box"].get_transform().translate(vec3(0.0f, 1.0f, 10.0f));
 
-	textures["teapot"] = texture("res/textures/metal_smooth.jpg");
+	load_texture("res/textures/metal_smooth.jpg", textures["teapot"]);
 	materials["teapot"] = material(colours["black"], colours["white"], colours["white"], 30.0f);
-	meshes["teapot"] = mesh(geometry("res/models/teapot_s2.obj"));
+	load_cached_model("teapot", "res/models/teapot_s2.obj");
+	meshes["teapot"] = mesh();
 	meshes["teapot"].get_transform().scale = vec3(25.0f, 25.0f, 25.0f);
 	meshes["teapot"].get_transform().translate(vec3(5.0f, 0.0f, 5.0f));
 	meshes["teapot"].get_transform().rotate(vec3(1.0f, 0.0f, 0.0f) * 15.0f);
 
-	textures["car"] = texture("res/textures/metal_tread.jpg");
+	load_texture("res/textures/metal_tread.jpg", textures["car"]);
 	materials["car"] = material(colours["black"], colours["red"], colours["white"], 20.0f);
-	meshes["car"] = mesh(geometry("res/models/car2.obj"));
+	load_cached_model("car", "res/models/car2.obj");
+	meshes["car"] = mesh();
 	meshes["car"].get_transform().scale = vec3(0.05f, 0.05f, 0.05f);
 	meshes["car"].get_transform().translate(vec3(-10.0f, 0.0f, -5.0f));
 	meshes["car"].get_transform().rotate(vec3(0.0f, 0.0f, half_pi<float>() / 2.0f) * 50.0f);
@@ -239,11 +278,22 @@ bool load_content()
 		meshes[name].set_material(materials[name]);
 	}
 
-	geometry geom;
-	texture height_map("res/textures/sinemap2.png");
-	terrain_tex = texture("res/textures/grid3.png");
-	generate_terrain(geom, height_map, 45.0f, 45.0f, 3.0f);
-	terr = mesh(geom);
+	// terr carries the terrain transform and material, the chunks carry the geometry
+	// The tiled copy of the height map is made on first run or when the map
+	// changes, then streamed a chunk at a time with 4 MB of vertex data resident.
+	// Decoding and tiling happen on a worker; only the chunk buffers need the
+	// main thread.  Height queries read the same tiles in place.
+	assets.load([]() { return tiled_heightfield::open("res/textures/sinemap2.png", "res/textures/sinemap2.thf", 64); },
+		[](tiled_heightfield tiles) {
+			terrain_tiles = move(tiles);
+			terrain.build(terrain_tiles, 45, 45, 3.0f, 4 * 1024 * 1024);
+			terrain_query = heightfield(terrain_tiles, 45, 45, 3.0f);
+
+			// Sit the car on the ground
+			auto& car_position = meshes["car"].get_transform().position;
+			car_position.y = terr.get_transform().position.y + terrain_query.height_at(car_position.x, car_position.z);
+		});
+	load_texture("res/textures/grid3.png", terrain_tex);
 	terr.get_transform().position = vec3(0.0f, -5.0f, 0.0f);
 	terr.set_material(material(colours["black"], colours["white"], colours["white"], 20.0f));
 
@@ -271,7 +321,9 @@ bool load_content()
 	spot.set_power(10.0f);
 
 	// Load shaders
-	eff.add_shader("res/shaders/shader.vert", GL_VERTEX_SHADER);
+	// Every mesh is drawn from a packed model
+	eff.add_shader("res/shaders/packed.vert", GL_VERTEX_SHADER);
+	eff.add_shader("res/shaders/part_octahedral.vert", GL_VERTEX_SHADER);
 	eff.add_shader("res/shaders/shader.frag", GL_FRAGMENT_SHADER);
 	eff.add_shader("res/shaders/part_direction.frag", GL_FRAGMENT_SHADER);
 	eff.add_shader("res/shaders/part_point.frag", GL_FRAGMENT_SHADER);
@@ -280,8 +332,10 @@ bool load_content()
 	sky_eff.add_shader("res/shaders/skybox.vert", GL_VERTEX_SHADER);
 	sky_eff.add_shader("res/shaders/skybox.frag", GL_FRAGMENT_SHADER);
 	terr_eff.add_shader("res/shaders/terrain.vert", GL_VERTEX_SHADER);
+	terr_eff.add_shader("res/shaders/part_octahedral.vert", GL_VERTEX_SHADER);
 	terr_eff.add_shader("res/shaders/terrain.frag", GL_FRAGMENT_SHADER);
-	shadow_eff.add_shader("res/shaders/shader.vert", GL_VERTEX_SHADER);
+	shadow_eff.add_shader("res/shaders/packed.vert", GL_VERTEX_SHADER);
+	shadow_eff.add_shader("res/shaders/part_octahedral.vert", GL_VERTEX_SHADER);
 	shadow_eff.add_shader("res/shaders/shader.frag", GL_FRAGMENT_SHADER);
 	shadow_eff.add_shader("res/shaders/part_direction.frag", GL_FRAGMENT_SHADER);
 	shadow_eff.add_shader("res/shaders/part_point.frag", GL_FRAGMENT_SHADER);
@@ -362,14 +416,17 @@ void render_terrain()
 	// Bind lights
 	renderer::bind(light, "light");
 	// Bind texture
-	renderer::bind(terrain_tex, 0);
+	bind_texture(terrain_tex, 0);
 	// Set texture uniform
 	glUniform1i(terr_eff.get_uniform_location("tex"), 0);
 	// Set eye position uniform
 	glUniform3fv(terr_eff.get_uniform_location("eye_pos"), 1,
 		value_ptr(cam.get_position()));
+	// Cull chunks and pick their detail level in the terrain's own space
+	auto local_eye = vec3(inverse(M) * vec4(cam.get_position(), 1.0f));
+	terrain.update(MVP, local_eye);
 	// Render terrain
-	renderer::render(terr);
+	terrain.render();
 }
 
 mat4 LightProjectionMat;
@@ -393,7 +450,7 @@ void render_shadows()
 	for (auto& e : meshes) {
 		auto m = e.second;
 		// Create MVP matrix
-		auto M = m.get_transform().get_transform_matrix();
+		auto M = model_matrix(e.first, m);
 		// View matrix taken from shadow map
 		auto V = shadow.get_view();
 		auto MVP = LightProjectionMat * V * M;
@@ -401,7 +458,7 @@ void render_shadows()
 		glUniformMatrix4fv(shadow_eff.get_uniform_location("MVP"),
 			1, GL_FALSE, value_ptr(MVP));
 		// Render mesh
-		renderer::render(m);
+		render_mesh(e.first, m, LightProjectionMat * V, true);
 	}
 	// Set render target back to the frame
 	renderer::set_render_target(frame);
@@ -420,7 +477,7 @@ void render_meshes()
 		renderer::bind(eff);
 
 		// Create MVP matrix
-		auto M = m.get_transform().get_transform_matrix();
+		auto M = model_matrix(e.first, m);
 		auto V = cam.get_view();
 		auto P = cam.get_projection();
 		auto MVP = P * V * M;
@@ -428,6 +485,8 @@ void render_meshes()
 		// Set MVP matrix uniform
 		glUniformMatrix4fv(eff.get_uniform_location("MVP"),
 			1, GL_FALSE, value_ptr(MVP));
+		// Set model matrix uniform
+		glUniformMatrix4fv(eff.get_uniform_location("M"), 1, GL_FALSE, value_ptr(M));
 
 		// Set normal matrix uniform
 		glUniformMatrix3fv(eff.get_uniform_location("N"), 1, GL_FALSE,
@@ -449,7 +508,7 @@ void render_meshes()
 		renderer::bind(points, "points");
 		renderer::bind(spot, "spot");
 		// Bind textures
-		renderer::bind(textures[e.first], 0);
+		bind_texture(textures[e.first], 0);
 
 		// Set texture uniform
 		glUniform1i(eff.get_uniform_location("tex"), 0);
@@ -464,12 +523,32 @@ void render_meshes()
 		glUniform1i(eff.get_uniform_location("shadow_map"), 1);
 
 		// Render mesh
-		renderer::render(m);
+		render_mesh(e.first, m, P * V);
 	}
 }
 
+// Loading frame - a bar across the screen filling as the assets arrive
+void render_loading()
+{
+	renderer::set_render_target();
+	renderer::clear();
+	auto width = renderer::get_screen_width(), height = renderer::get_screen_height();
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(width / 4, height / 2 - 8, static_cast<GLsizei>(width / 2 * assets.progress()), 16);
+	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+	renderer::setClearColour(0.0f, 0.0f, 0.0f);
+}
+
 bool render()
 {
+	// Create the GL objects of what has loaded, and show progress until everything has
+	if (!assets.upload(upload_budget_ms)) {
+		render_loading();
+		return true;
+	}
+
 	// Set render target to frame buffer
 	renderer::set_render_target(frame);
 	// Clear frame
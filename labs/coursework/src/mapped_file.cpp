@@ -0,0 +1,134 @@
+#include "mapped_file.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+mapped_file::mapped_file(const string& filename)
+{
+#ifdef _WIN32
+	_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		_file = nullptr;
+		throw runtime_error("Could not open file " + filename);
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(_file, &size);
+	_size = static_cast<size_t>(size.QuadPart);
+	// Mapping an empty file fails, so leave it unmapped
+	if (_size == 0) {
+		return;
+	}
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping) {
+		_data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	_fd = open(filename.c_str(), O_RDONLY);
+	if (_fd < 0) {
+		throw runtime_error("Could not open file " + filename);
+	}
+	struct stat info;
+	fstat(_fd, &info);
+	_size = static_cast<size_t>(info.st_size);
+	// Mapping an empty file fails, so leave it unmapped
+	if (_size == 0) {
+		return;
+	}
+	auto mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	if (mapping != MAP_FAILED) {
+		_data = static_cast<const char*>(mapping);
+	}
+#endif
+	if (!_data) {
+		close();
+		throw runtime_error("Could not map file " + filename);
+	}
+}
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+mapped_file::mapped_file(mapped_file&& other)
+{
+	*this = move(other);
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other)
+{
+	if (this != &other) {
+		close();
+		swap(_data, other._data);
+		swap(_size, other._size);
+#ifdef _WIN32
+		swap(_file, other._file);
+		swap(_mapping, other._mapping);
+#else
+		swap(_fd, other._fd);
+#endif
+	}
+	return *this;
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+	if (_data) {
+		UnmapViewOfFile(_data);
+	}
+	if (_mapping) {
+		CloseHandle(_mapping);
+	}
+	if (_file) {
+		CloseHandle(_file);
+	}
+	_file = nullptr;
+	_mapping = nullptr;
+#else
+	if (_data) {
+		munmap(const_cast<char*>(_data), _size);
+	}
+	if (_fd >= 0) {
+		::close(_fd);
+	}
+	_fd = -1;
+#endif
+	_data = nullptr;
+	_size = 0;
+}
+
+uint64_t hash_bytes(const char* data, size_t size)
+{
+	// FNV-1a taking 8 bytes a step rather than one, so hashing keeps up with the
+	// mapping; a final mix spreads the last words into every bit
+	uint64_t h = 14695981039346656037ull;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		h = (h ^ word) * 1099511628211ull;
+	}
+	for (; i < size; ++i) {
+		h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
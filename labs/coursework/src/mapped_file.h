@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A read-only view of a whole file mapped into memory
+class mapped_file
+{
+private:
+	// Start of the mapped bytes
+	const char* _data = nullptr;
+	// Size of the file in bytes
+	size_t _size = 0;
+#ifdef _WIN32
+	// File and mapping handles, kept as void* so windows.h stays out of the header
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#else
+	// File descriptor
+	int _fd = -1;
+#endif
+
+	// Unmaps and closes everything
+	void close();
+
+public:
+	mapped_file() = default;
+	// Maps the given file, throwing std::runtime_error if it cannot be opened
+	explicit mapped_file(const std::string& filename);
+	~mapped_file();
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+	mapped_file(mapped_file&& other);
+	mapped_file& operator=(mapped_file&& other);
+
+	// Mapped bytes, or nullptr for an empty or unopened file
+	const char* data() const { return _data; }
+	// Size of the file in bytes
+	size_t size() const { return _size; }
+	// Whether a file is mapped
+	bool is_open() const { return _data != nullptr; }
+};
+
+// 64-bit FNV-1a style hash of size bytes, taken a word at a time, for telling
+// whether a file derived from another is still up to date
+uint64_t hash_bytes(const char* data, size_t size);
@@ -0,0 +1,206 @@
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+	// Header describing mesh, bounds included
+	cached_mesh::header make_header(const obj_data& mesh, uint64_t source_hash, uint64_t pipeline_hash, bool packed)
+	{
+		// Zeroed so the padding is too, and the same mesh always writes the same file
+		cached_mesh::header h = {};
+		memcpy(h.magic, "MSH1", 4);
+		h.version = cached_mesh::current_version;
+		h.source_hash = source_hash;
+		h.pipeline_hash = pipeline_hash;
+		h.vertex_count = static_cast<uint32_t>(mesh.positions.size());
+		h.index_count = static_cast<uint32_t>(mesh.indices.size());
+		h.lod_count = static_cast<uint32_t>(mesh.lods.size());
+		h.cluster_count = static_cast<uint32_t>(mesh.clusters.size());
+		h.packed = packed ? 1 : 0;
+		vec3 low(0.0f), high(0.0f);
+		if (!mesh.positions.empty()) {
+			low = high = mesh.positions[0];
+			for (auto& p : mesh.positions) {
+				low = min(low, p);
+				high = max(high, p);
+			}
+		}
+		memcpy(h.bounds_min, &low, sizeof(h.bounds_min));
+		memcpy(h.bounds_max, &high, sizeof(h.bounds_max));
+		return h;
+	}
+}
+
+cached_mesh::cached_mesh(const string& filename) : _file(filename)
+{
+	if (_file.size() < sizeof(header)) {
+		throw runtime_error("Mesh cache " + filename + " is too small");
+	}
+	memcpy(&_header, _file.data(), sizeof(header));
+	if (memcmp(_header.magic, "MSH1", 4) != 0 || _header.version != current_version) {
+		throw runtime_error("Mesh cache " + filename + " has an unknown format");
+	}
+
+	// Check the file really holds every stream before handing out pointers into it
+	size_t vertices = _header.vertex_count;
+	auto vertex_size =
+		is_packed() ? 4 * sizeof(uint16_t) + sizeof(packed_attributes) : 2 * sizeof(vec3) + sizeof(vec2);
+	size_t expected = sizeof(header) + vertices * vertex_size +
+		static_cast<size_t>(_header.index_count) * sizeof(uint32_t) + _header.lod_count * sizeof(mesh_lod) +
+		static_cast<size_t>(_header.cluster_count) * sizeof(mesh_cluster);
+	if (_file.size() < expected) {
+		throw runtime_error("Mesh cache " + filename + " is truncated");
+	}
+	auto data = _file.data() + sizeof(header);
+	if (is_packed()) {
+		_packed_positions = reinterpret_cast<const uint16_t*>(data);
+		_attributes = reinterpret_cast<const packed_attributes*>(_packed_positions + vertices * 4);
+		_indices = reinterpret_cast<const uint32_t*>(_attributes + vertices);
+	} else {
+		_positions = reinterpret_cast<const vec3*>(data);
+		_normals = _positions + vertices;
+		_tex_coords = reinterpret_cast<const vec2*>(_normals + vertices);
+		_indices = reinterpret_cast<const uint32_t*>(_tex_coords + vertices);
+	}
+	_lods = reinterpret_cast<const mesh_lod*>(_indices + _header.index_count);
+	_clusters = reinterpret_cast<const mesh_cluster*>(_lods + _header.lod_count);
+	for (size_t i = 0; i < _header.lod_count; ++i) {
+		if (static_cast<size_t>(_lods[i].first) + _lods[i].count > _header.index_count) {
+			throw runtime_error("Mesh cache " + filename + " has a level of detail past its indices");
+		}
+	}
+	for (size_t i = 0; i < _header.cluster_count; ++i) {
+		if (static_cast<size_t>(_clusters[i].first) + _clusters[i].count > _header.index_count) {
+			throw runtime_error("Mesh cache " + filename + " has a cluster past its indices");
+		}
+	}
+}
+
+void cached_mesh::use_owned(uint64_t source_hash, uint64_t pipeline_hash, bool packed)
+{
+	_header = make_header(_owned, source_hash, pipeline_hash, packed);
+	if (packed) {
+		size_t vertices = _header.vertex_count;
+		_owned_positions.resize(vertices * 4);
+		_owned_attributes.resize(vertices);
+		pack_vertices(vertices, _owned.positions.data(), _owned.normals.data(), _owned.tex_coords.data(),
+			bounds_min(), bounds_max(), _owned_positions.data(), _owned_attributes.data());
+		_packed_positions = _owned_positions.data();
+		_attributes = _owned_attributes.data();
+	} else {
+		_positions = _owned.positions.data();
+		_normals = _owned.normals.data();
+		_tex_coords = _owned.tex_coords.data();
+	}
+	_indices = _owned.indices.data();
+	_lods = _owned.lods.data();
+	_clusters = _owned.clusters.data();
+}
+
+vector<mesh_lod> cached_mesh::lods() const
+{
+	if (_header.lod_count == 0) {
+		return { { 0, _header.index_count, 0.0f } };
+	}
+	return vector<mesh_lod>(_lods, _lods + _header.lod_count);
+}
+
+vector<mesh_cluster> cached_mesh::clusters() const
+{
+	return vector<mesh_cluster>(_clusters, _clusters + _header.cluster_count);
+}
+
+cached_mesh cached_mesh::open(const string& source, const string& pipeline, const parser& parse, bool packed)
+{
+	mapped_file file(source);
+	auto source_hash = hash(file.data(), file.size());
+	auto pipeline_hash = hash(pipeline.data(), pipeline.size());
+	auto cache_name = source + "." + pipeline + ".mesh";
+
+	// Use the cache when it was built from this exact source by this pipeline, in this format
+	try {
+		cached_mesh cache(cache_name);
+		if (cache._header.source_hash == source_hash && cache._header.pipeline_hash == pipeline_hash &&
+			cache.is_packed() == packed) {
+			return cache;
+		}
+	} catch (const runtime_error&) {
+		// Missing or stale, so build it again below
+	}
+
+	cached_mesh built;
+	parse(file.data(), file.size(), built._owned);
+	built.use_owned(source_hash, pipeline_hash, packed);
+	try {
+		write(built._owned, source_hash, pipeline_hash, cache_name, packed);
+		return cached_mesh(cache_name);
+	} catch (const runtime_error&) {
+		// Read only folder - keep the parsed mesh
+		return built;
+	}
+}
+
+void cached_mesh::write(const obj_data& mesh, uint64_t source_hash, uint64_t pipeline_hash, const string& filename,
+	bool packed)
+{
+	auto vertices = mesh.positions.size();
+	if (mesh.normals.size() != vertices || mesh.tex_coords.size() != vertices) {
+		throw runtime_error("Mesh for " + filename + " has streams of different lengths");
+	}
+
+	auto h = make_header(mesh, source_hash, pipeline_hash, packed);
+	vector<uint16_t> packed_positions;
+	vector<packed_attributes> attributes;
+	if (packed) {
+		packed_positions.resize(vertices * 4);
+		attributes.resize(vertices);
+		vec3 low, high;
+		memcpy(&low, h.bounds_min, sizeof(h.bounds_min));
+		memcpy(&high, h.bounds_max, sizeof(h.bounds_max));
+		pack_vertices(vertices, mesh.positions.data(), mesh.normals.data(), mesh.tex_coords.data(), low, high,
+			packed_positions.data(), attributes.data());
+	}
+
+	// Written under a temporary name and renamed, so a reader never maps half a file
+	auto temporary = filename + ".tmp";
+	{
+		ofstream file(temporary, ios::binary);
+		if (!file) {
+			throw runtime_error("Could not create mesh cache " + filename);
+		}
+		file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		if (packed) {
+			file.write(reinterpret_cast<const char*>(packed_positions.data()),
+				packed_positions.size() * sizeof(uint16_t));
+			file.write(reinterpret_cast<const char*>(attributes.data()), vertices * sizeof(packed_attributes));
+		} else {
+			file.write(reinterpret_cast<const char*>(mesh.positions.data()), vertices * sizeof(vec3));
+			file.write(reinterpret_cast<const char*>(mesh.normals.data()), vertices * sizeof(vec3));
+			file.write(reinterpret_cast<const char*>(mesh.tex_coords.data()), vertices * sizeof(vec2));
+		}
+		file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(mesh.lods.data()), mesh.lods.size() * sizeof(mesh_lod));
+		file.write(reinterpret_cast<const char*>(mesh.clusters.data()), mesh.clusters.size() * sizeof(mesh_cluster));
+		if (!file) {
+			throw runtime_error("Could not write mesh cache " + filename);
+		}
+	}
+	remove(filename.c_str());
+	if (rename(temporary.c_str(), filename.c_str()) != 0) {
+		remove(temporary.c_str());
+		throw runtime_error("Could not replace mesh cache " + filename);
+	}
+}
+
+uint64_t cached_mesh::hash(const char* data, size_t size)
+{
+	return hash_bytes(data, size);
+}
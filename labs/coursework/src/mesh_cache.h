@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mapped_file.h"
+#include "obj_loader.h"
+#include "vertex_packing.h"
+
+// A mesh ready for upload, read from a "MSH1" cache file.  The file holds a
+// header, then the position, normal and texture coordinate streams, the 32-bit
+// index stream, the table of levels of detail and the table of clusters one
+// after another, exactly as the GPU takes them, so loading is a map and the
+// streams are uploaded straight from the mapping.  A packed cache holds
+// gpu_mesh's packed split layout instead of the float streams: 16-bit positions
+// in the bounding box, then packed_attributes (pack_vertices).
+//
+// open() keeps the cache next to its source asset, named for the pipeline that
+// built it (model.obj -> model.obj.<pipeline>.mesh), and rebuilds it whenever
+// the source's content hash or the pipeline recorded in it no longer matches.
+class cached_mesh
+{
+public:
+	struct header
+	{
+		char magic[4];
+		uint32_t version;
+		// Hash of the source file the mesh was built from
+		uint64_t source_hash;
+		// Hash of the name of the pipeline that built it
+		uint64_t pipeline_hash;
+		uint32_t vertex_count;
+		uint32_t index_count;
+		// Entries in the level of detail table, 0 for a single level
+		uint32_t lod_count;
+		// Entries in the cluster table, 0 when the mesh was not clustered
+		uint32_t cluster_count;
+		// 1 when the vertices are in the packed format, 0 for float streams
+		uint32_t packed;
+		// Bounding box of the positions
+		float bounds_min[3];
+		float bounds_max[3];
+	};
+
+	// The header is written as it is laid out in memory
+	static_assert(sizeof(header) == 72, "Mesh cache header layout changed");
+
+	static const uint32_t current_version = 7;
+
+	// Parses a source asset already in memory into an indexed mesh
+	using parser = std::function<void(const char* data, size_t size, obj_data& out)>;
+
+private:
+	mapped_file _file;
+	// Holds the mesh when it could not be written to a cache file
+	obj_data _owned;
+	header _header = {};
+	const glm::vec3* _positions = nullptr;
+	const glm::vec3* _normals = nullptr;
+	const glm::vec2* _tex_coords = nullptr;
+	// Packed streams, four values a vertex for the positions
+	std::vector<uint16_t> _owned_positions;
+	std::vector<packed_attributes> _owned_attributes;
+	const uint16_t* _packed_positions = nullptr;
+	const packed_attributes* _attributes = nullptr;
+	const uint32_t* _indices = nullptr;
+	const mesh_lod* _lods = nullptr;
+	const mesh_cluster* _clusters = nullptr;
+
+	// Points the streams at the mesh held in memory, packing it first if asked
+	void use_owned(uint64_t source_hash, uint64_t pipeline_hash, bool packed);
+
+public:
+	cached_mesh() = default;
+	// Maps a cache file, throwing std::runtime_error if it is missing, truncated
+	// or from another version of the format
+	explicit cached_mesh(const std::string& filename);
+
+	cached_mesh(cached_mesh&&) = default;
+	cached_mesh& operator=(cached_mesh&&) = default;
+
+	// Loads the cache of source built by pipeline, parsing the source and writing
+	// a new cache first when there is none or the source has changed.  pipeline
+	// names what parse does to the mesh, so callers processing it differently
+	// keep separate caches; it must change whenever parse does.  If the cache
+	// cannot be written the parsed mesh is used from memory.  A packed cache only
+	// has the packed streams, so positions(), normals() and tex_coords() are null.
+	static cached_mesh open(const std::string& source, const std::string& pipeline, const parser& parse,
+		bool packed = false);
+
+	// Writes mesh as a cache file for a source and pipeline with the given hashes
+	static void write(const obj_data& mesh, uint64_t source_hash, uint64_t pipeline_hash,
+		const std::string& filename, bool packed = false);
+
+	// Content hash of size bytes (hash_bytes), as the header records it
+	static uint64_t hash(const char* data, size_t size);
+
+	const header& get_header() const { return _header; }
+	size_t vertex_count() const { return _header.vertex_count; }
+	size_t index_count() const { return _header.index_count; }
+	const glm::vec3* positions() const { return _positions; }
+	const glm::vec3* normals() const { return _normals; }
+	const glm::vec2* tex_coords() const { return _tex_coords; }
+	bool is_packed() const { return _header.packed != 0; }
+	// Packed streams, null unless is_packed()
+	const uint16_t* packed_positions() const { return _packed_positions; }
+	const packed_attributes* attributes() const { return _attributes; }
+	const uint32_t* indices() const { return _indices; }
+	// Levels of detail, finest first; a mesh without any has one covering every index
+	std::vector<mesh_lod> lods() const;
+	// Clusters of every level in index order, if the mesh has them
+	std::vector<mesh_cluster> clusters() const;
+	glm::vec3 bounds_min() const { return glm::vec3(_header.bounds_min[0], _header.bounds_min[1], _header.bounds_min[2]); }
+	glm::vec3 bounds_max() const { return glm::vec3(_header.bounds_max[0], _header.bounds_max[1], _header.bounds_max[2]); }
+};
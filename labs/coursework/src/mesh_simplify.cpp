@@ -0,0 +1,436 @@
+#include "mesh_simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "vertex_cache.h"
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+	// Exact bits of a position, so vertices share a key only when they share a
+	// position; -0 is keyed as +0, the value it equals
+	struct position_key
+	{
+		uint32_t bits[3];
+
+		explicit position_key(const vec3& p)
+		{
+			memcpy(bits, &p, sizeof(bits));
+			for (auto& b : bits) {
+				b = b == 0x80000000u ? 0 : b;
+			}
+		}
+		bool operator==(const position_key& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+	};
+
+	struct position_key_hash
+	{
+		size_t operator()(const position_key& k) const
+		{
+			auto h = (static_cast<uint64_t>(k.bits[0]) * 0x9e3779b97f4a7c15ull) ^
+				(static_cast<uint64_t>(k.bits[1]) * 0xc2b2ae3d27d4eb4full) ^ k.bits[2];
+			return static_cast<size_t>(h ^ (h >> 32));
+		}
+	};
+
+	// Sum of squared distances to a set of planes, weighted by area:
+	// error(p) = p.A.p + 2 b.p + c, with A symmetric
+	struct quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0, c = 0;
+		double weight = 0;
+
+		// Adds the plane through point with unit normal n
+		void add_plane(const dvec3& n, const dvec3& point, double w)
+		{
+			auto d = -dot(n, point);
+			a00 += w * n.x * n.x;
+			a01 += w * n.x * n.y;
+			a02 += w * n.x * n.z;
+			a11 += w * n.y * n.y;
+			a12 += w * n.y * n.z;
+			a22 += w * n.z * n.z;
+			b0 += w * n.x * d;
+			b1 += w * n.y * d;
+			b2 += w * n.z * d;
+			c += w * d * d;
+			weight += w;
+		}
+
+		void add(const quadric& q)
+		{
+			a00 += q.a00;
+			a01 += q.a01;
+			a02 += q.a02;
+			a11 += q.a11;
+			a12 += q.a12;
+			a22 += q.a22;
+			b0 += q.b0;
+			b1 += q.b1;
+			b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		// Mean squared distance of p from the planes
+		double error(const vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			auto e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+				2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			return std::abs(e) / std::max(weight, 1e-30);
+		}
+	};
+
+	// What a position may collapse onto
+	enum class vertex_kind
+	{
+		// Surrounded by triangles and with one vertex: anywhere
+		manifold,
+		// On an open edge: along the border to another border or locked position
+		border,
+		// Two vertices either side of a texture or normal seam: along the seam
+		seam,
+		// Never moves
+		locked
+	};
+
+	// Longest side of the mesh's bounding box
+	float mesh_extent(const obj_data& mesh)
+	{
+		if (mesh.positions.empty()) {
+			return 0.0f;
+		}
+		vec3 low = mesh.positions[0], high = mesh.positions[0];
+		for (auto& p : mesh.positions) {
+			low = min(low, p);
+			high = max(high, p);
+		}
+		return std::max(std::max(high.x - low.x, high.y - low.y), high.z - low.z);
+	}
+
+	inline uint64_t edge_key(uint32_t a, uint32_t b) { return (static_cast<uint64_t>(a) << 32) | b; }
+
+	// A possible collapse of one vertex onto another
+	struct collapse
+	{
+		uint32_t from, to;
+		// Second pair moved with a seam collapse, the same as the first when there is none
+		uint32_t sibling_from, sibling_to;
+		double cost;
+	};
+}
+
+float simplify_mesh(const obj_data& mesh, const uint32_t* indices, size_t count, size_t target_count,
+	float target_error, vector<uint32_t>& out)
+{
+	out.assign(indices, indices + count - count % 3);
+	auto vertex_count = mesh.positions.size();
+	if (out.size() <= target_count || vertex_count == 0) {
+		return 0.0f;
+	}
+	auto& positions = mesh.positions;
+
+	// Vertices sharing a position are one position to the simplifier, named by
+	// their first vertex, and are linked in a ring through next_wedge
+	vector<uint32_t> position_of(vertex_count), next_wedge(vertex_count);
+	{
+		unordered_map<position_key, uint32_t, position_key_hash> first;
+		first.reserve(vertex_count);
+		vector<uint32_t> last(vertex_count);
+		for (uint32_t v = 0; v < vertex_count; ++v) {
+			auto owner = first.emplace(position_key(positions[v]), v).first->second;
+			position_of[v] = owner;
+			if (owner == v) {
+				next_wedge[v] = v;
+				last[v] = v;
+			} else {
+				next_wedge[last[owner]] = v;
+				next_wedge[v] = owner;
+				last[owner] = v;
+			}
+		}
+	}
+
+	// Moves every corner through remap and drops the triangles that closed up
+	vector<uint32_t> remap(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		remap[v] = v;
+	}
+	auto apply_remap = [&]() {
+		size_t kept = 0;
+		for (size_t i = 0; i < out.size(); i += 3) {
+			auto a = remap[out[i]], b = remap[out[i + 1]], c = remap[out[i + 2]];
+			auto pa = position_of[a], pb = position_of[b], pc = position_of[c];
+			if (pa != pb && pb != pc && pa != pc) {
+				out[kept++] = a;
+				out[kept++] = b;
+				out[kept++] = c;
+			}
+		}
+		out.resize(kept);
+	};
+	// Triangles with two corners at one position have no area to simplify
+	apply_remap();
+
+	// Half edges of the current triangles, by vertex and by position
+	unordered_set<uint64_t> edges, position_edges;
+	auto build_edges = [&]() {
+		edges.clear();
+		position_edges.clear();
+		for (size_t i = 0; i < out.size(); i += 3) {
+			for (int k = 0; k < 3; ++k) {
+				auto a = out[i + k], b = out[i + (k + 1) % 3];
+				edges.insert(edge_key(a, b));
+				position_edges.insert(edge_key(position_of[a], position_of[b]));
+			}
+		}
+	};
+	edges.reserve(out.size() * 2);
+	position_edges.reserve(out.size() * 2);
+	build_edges();
+
+	// Classify each position from the edges around it
+	vector<vertex_kind> kinds(vertex_count, vertex_kind::manifold);
+	{
+		vector<uint8_t> open_position(vertex_count, 0);
+		vector<uint8_t> open_out(vertex_count, 0), open_in(vertex_count, 0);
+		for (size_t i = 0; i < out.size(); i += 3) {
+			for (int k = 0; k < 3; ++k) {
+				auto a = out[i + k], b = out[i + (k + 1) % 3];
+				if (!position_edges.count(edge_key(position_of[b], position_of[a]))) {
+					open_position[position_of[a]] = open_position[position_of[b]] = 1;
+				} else if (!edges.count(edge_key(b, a))) {
+					open_out[a] = std::min(open_out[a] + 1, 2);
+					open_in[b] = std::min(open_in[b] + 1, 2);
+				}
+			}
+		}
+		for (uint32_t v = 0; v < vertex_count; ++v) {
+			if (position_of[v] != v) {
+				continue;
+			}
+			auto other = next_wedge[v];
+			if (other == v) {
+				kinds[v] = open_position[v] ? vertex_kind::border : vertex_kind::manifold;
+			} else if (next_wedge[other] == v && !open_position[v] && open_out[v] == 1 && open_in[v] == 1 &&
+				open_out[other] == 1 && open_in[other] == 1) {
+				kinds[v] = vertex_kind::seam;
+			} else {
+				kinds[v] = vertex_kind::locked;
+			}
+		}
+	}
+
+	// Plane of every triangle at each of its positions, and planes standing up
+	// from open edges so borders keep their shape
+	vector<quadric> quadrics(vertex_count);
+	for (size_t i = 0; i < out.size(); i += 3) {
+		dvec3 p[3];
+		uint32_t id[3];
+		for (int k = 0; k < 3; ++k) {
+			id[k] = position_of[out[i + k]];
+			p[k] = dvec3(positions[id[k]]);
+		}
+		auto normal = cross(p[1] - p[0], p[2] - p[0]);
+		auto area = length(normal);
+		if (area <= 0.0) {
+			continue;
+		}
+		normal /= area;
+		for (int k = 0; k < 3; ++k) {
+			quadrics[id[k]].add_plane(normal, p[0], area * 0.5);
+		}
+		for (int k = 0; k < 3; ++k) {
+			auto a = id[k], b = id[(k + 1) % 3];
+			if (!position_edges.count(edge_key(b, a))) {
+				auto edge = p[(k + 1) % 3] - p[k];
+				auto edge_length = length(edge);
+				if (edge_length > 0.0) {
+					auto side = normalize(cross(edge, normal));
+					auto w = edge_length * edge_length * 10.0;
+					quadrics[a].add_plane(side, p[k], w);
+					quadrics[b].add_plane(side, p[k], w);
+				}
+			}
+		}
+	}
+
+	auto extent = mesh_extent(mesh);
+	auto error_limit = static_cast<double>(target_error) * extent * target_error * extent;
+	double result_error = 0.0;
+
+	vector<collapse> candidates;
+	vector<uint8_t> locked(vertex_count);
+	vector<uint32_t> adjacency_offsets(vertex_count + 1), adjacency;
+	while (out.size() > target_count) {
+		// Every allowed collapse along every edge, each edge seen from the triangle
+		// holding it as a->b with a < b, or the only triangle on an open edge
+		candidates.clear();
+		auto consider = [&](uint32_t from, uint32_t to) {
+			auto pa = position_of[from], pb = position_of[to];
+			collapse c = { from, to, from, to, 0.0 };
+			switch (kinds[pa]) {
+			case vertex_kind::manifold:
+				break;
+			case vertex_kind::border:
+				if ((kinds[pb] != vertex_kind::border && kinds[pb] != vertex_kind::locked) ||
+					(position_edges.count(edge_key(pa, pb)) && position_edges.count(edge_key(pb, pa)))) {
+					return;
+				}
+				break;
+			case vertex_kind::seam: {
+				if ((kinds[pb] != vertex_kind::seam && kinds[pb] != vertex_kind::locked) ||
+					(edges.count(edge_key(from, to)) && edges.count(edge_key(to, from)))) {
+					return;
+				}
+				// The other side of the seam moves with it, onto the vertex of pb it shares an edge with
+				auto other = next_wedge[from];
+				auto w = pb;
+				do {
+					if (edges.count(edge_key(other, w)) || edges.count(edge_key(w, other))) {
+						c.sibling_from = other;
+						c.sibling_to = w;
+						break;
+					}
+					w = next_wedge[w];
+				} while (w != pb);
+				if (c.sibling_from == c.from) {
+					return;
+				}
+				break;
+			}
+			case vertex_kind::locked:
+				return;
+			}
+			c.cost = quadrics[pa].error(positions[pb]);
+			candidates.push_back(c);
+		};
+		for (size_t i = 0; i < out.size(); i += 3) {
+			for (int k = 0; k < 3; ++k) {
+				auto a = out[i + k], b = out[i + (k + 1) % 3];
+				auto pa = position_of[a], pb = position_of[b];
+				if (pa < pb || !position_edges.count(edge_key(pb, pa))) {
+					consider(a, b);
+					consider(b, a);
+				}
+			}
+		}
+		if (candidates.empty()) {
+			break;
+		}
+		sort(candidates.begin(), candidates.end(), [](const collapse& x, const collapse& y) { return x.cost < y.cost; });
+
+		// Triangles around each position, for the flip test
+		fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+		for (auto v : out) {
+			++adjacency_offsets[position_of[v] + 1];
+		}
+		for (size_t v = 0; v < vertex_count; ++v) {
+			adjacency_offsets[v + 1] += adjacency_offsets[v];
+		}
+		adjacency.resize(out.size());
+		{
+			auto filled = adjacency_offsets;
+			for (size_t i = 0; i < out.size(); ++i) {
+				adjacency[filled[position_of[out[i]]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		// Take the cheapest collapses that touch no position already changed this pass
+		for (uint32_t v = 0; v < vertex_count; ++v) {
+			remap[v] = v;
+		}
+		fill(locked.begin(), locked.end(), 0);
+		size_t removed = 0, needed = (out.size() - target_count) / 3;
+		for (auto& c : candidates) {
+			if (c.cost > error_limit || removed >= needed) {
+				break;
+			}
+			auto pa = position_of[c.from], pb = position_of[c.to];
+			if (locked[pa] || locked[pb]) {
+				continue;
+			}
+
+			// Refuse collapses that turn any remaining triangle around pa over
+			auto flips = false;
+			for (auto a = adjacency_offsets[pa]; a < adjacency_offsets[pa + 1] && !flips; ++a) {
+				auto t = adjacency[a] * 3;
+				vec3 before[3], after[3];
+				auto touches_b = false;
+				for (int k = 0; k < 3; ++k) {
+					auto id = position_of[out[t + k]];
+					touches_b |= id == pb;
+					before[k] = positions[id];
+					after[k] = id == pa ? positions[pb] : before[k];
+				}
+				if (!touches_b) {
+					auto n0 = cross(before[1] - before[0], before[2] - before[0]);
+					auto n1 = cross(after[1] - after[0], after[2] - after[0]);
+					flips = dot(n0, n1) <= 0.0f;
+				}
+			}
+			if (flips) {
+				continue;
+			}
+
+			remap[c.from] = c.to;
+			remap[c.sibling_from] = c.sibling_to;
+			quadrics[pb].add(quadrics[pa]);
+			result_error = std::max(result_error, c.cost);
+			removed += kinds[pa] == vertex_kind::border ? 1 : 2;
+			// The ring around pa changes shape, so nothing in it moves again this pass
+			for (auto a = adjacency_offsets[pa]; a < adjacency_offsets[pa + 1]; ++a) {
+				auto t = adjacency[a] * 3;
+				for (int k = 0; k < 3; ++k) {
+					locked[position_of[out[t + k]]] = 1;
+				}
+			}
+		}
+		// Apply the collapses, stopping once none of them closes a triangle
+		auto before = out.size();
+		apply_remap();
+		if (out.size() == before) {
+			break;
+		}
+		build_edges();
+	}
+	return static_cast<float>(sqrt(result_error));
+}
+
+void build_lod_chain(obj_data& mesh, unsigned int levels, float ratio, float max_error)
+{
+	mesh.lods.clear();
+	if (mesh.indices.empty()) {
+		return;
+	}
+	mesh.lods.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+
+	vector<uint32_t> current(mesh.indices), next;
+	auto extent = std::max(mesh_extent(mesh), 1e-30f);
+	auto error = 0.0f;
+	for (unsigned int level = 1; level < levels; ++level) {
+		// Each level's error is measured from the one before, so its limit is what is left of the total
+		auto remaining = max_error - error / extent;
+		if (remaining <= 0.0f) {
+			break;
+		}
+		auto target = static_cast<size_t>(current.size() / 3 * ratio) * 3;
+		auto level_error = simplify_mesh(mesh, current.data(), current.size(), target, remaining, next);
+		if (next.size() > current.size() * 9 / 10) {
+			break;
+		}
+		error += level_error;
+		optimise_vertex_cache(next.data(), next.size(), mesh.positions.size());
+		mesh.lods.push_back({ static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(next.size()), error });
+		mesh.indices.insert(mesh.indices.end(), next.begin(), next.end());
+		swap(current, next);
+	}
+}
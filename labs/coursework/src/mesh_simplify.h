@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "obj_loader.h"
+
+// Simplifies the triangles in indices[0, count) of mesh by collapsing edges,
+// cheapest first by quadric error (Garland and Heckbert), until no more than
+// target_count indices are left or a collapse would move the surface further
+// than target_error times the mesh's size.  Vertices only ever collapse onto
+// existing ones, so the result indexes mesh's vertices unchanged.  Borders
+// only collapse along themselves, texture and normal seams only along the seam
+// with both sides together, and anything more tangled stays put.  Returns the
+// surface error reached in model units.
+float simplify_mesh(const obj_data& mesh, const uint32_t* indices, size_t count, size_t target_count,
+	float target_error, std::vector<uint32_t>& out);
+
+// Builds up to levels levels of detail from a welded mesh, each with about
+// ratio times the triangles of the one before, stopping early once a level
+// would lose more than max_error times the mesh's size or stops shrinking.
+// Every level is cache optimised and stored in mesh.indices and mesh.lods.
+// Run after the other optimisation passes, which take a single index list.
+void build_lod_chain(obj_data& mesh, unsigned int levels = 4, float ratio = 0.5f, float max_error = 0.05f);
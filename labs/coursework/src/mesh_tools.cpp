@@ -0,0 +1,601 @@
+#include "mesh_tools.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+	// Grid cell of a position component, cells being spacing wide, or its bit
+	// pattern when not snapping so that only exact copies share a cell
+	inline int64_t position_cell(float value, float spacing)
+	{
+		if (spacing <= 0.0f) {
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			// +0 and -0 are the same value
+			return bits == 0x80000000u ? 0 : bits;
+		}
+		// Clamped so far off values cannot overflow the cell
+		auto cell = floor(static_cast<double>(value) / spacing);
+		return static_cast<int64_t>(std::max(std::min(cell, 4e18), -4e18));
+	}
+
+	// Cell of the position grid and the first welded vertex in it
+	struct weld_cell
+	{
+		int64_t cell[3];
+		uint32_t first;
+	};
+}
+
+weld_stats weld_mesh(obj_data& mesh, const weld_tolerance& tolerance)
+{
+	auto count = mesh.positions.size();
+	if (mesh.normals.size() != count || mesh.tex_coords.size() != count) {
+		throw runtime_error("Welding needs a normal and texture coordinate for every position");
+	}
+	if (mesh.indices.empty()) {
+		if (count % 3 != 0) {
+			throw runtime_error("Welding an unindexed mesh needs whole triangles");
+		}
+		mesh.indices.resize(count);
+		for (size_t i = 0; i < count; ++i) {
+			mesh.indices[i] = static_cast<uint32_t>(i);
+		}
+	}
+
+	weld_stats stats;
+	stats.vertices_before = count;
+
+	// Welded vertices are hashed by the cell of a grid as wide as the position
+	// tolerance that their position falls in.  Any vertex within tolerance of
+	// another lies in the same or a neighbouring cell, so only those 27 cells
+	// are searched, and each candidate found is compared against the tolerances.
+	auto reach = tolerance.position > 0.0f ? 1 : 0;
+	size_t capacity = 16;
+	while (capacity < count * 2) {
+		capacity *= 2;
+	}
+	vector<weld_cell> table(capacity, weld_cell{ { 0, 0, 0 }, UINT32_MAX });
+	// Slot of a cell, or the empty slot it would go in
+	auto find = [&](const int64_t* cell) {
+		uint64_t hash = 14695981039346656037ull;
+		for (int c = 0; c < 3; ++c) {
+			hash = (hash ^ static_cast<uint64_t>(cell[c])) * 1099511628211ull;
+		}
+		auto slot = static_cast<size_t>(hash ^ (hash >> 32)) & (capacity - 1);
+		while (table[slot].first != UINT32_MAX && memcmp(table[slot].cell, cell, sizeof(table[slot].cell)) != 0) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+		return slot;
+	};
+	auto close = [](float a, float b, float limit) { return abs(a - b) <= limit; };
+	auto position_limit = std::max(tolerance.position, 0.0f);
+	auto matches = [&](uint32_t a, uint32_t b) {
+		auto& pa = mesh.positions[a];
+		auto& pb = mesh.positions[b];
+		auto& na = mesh.normals[a];
+		auto& nb = mesh.normals[b];
+		auto& ta = mesh.tex_coords[a];
+		auto& tb = mesh.tex_coords[b];
+		return close(pa.x, pb.x, position_limit) && close(pa.y, pb.y, position_limit) &&
+			close(pa.z, pb.z, position_limit) && close(na.x, nb.x, tolerance.normal) &&
+			close(na.y, nb.y, tolerance.normal) && close(na.z, nb.z, tolerance.normal) &&
+			close(ta.x, tb.x, tolerance.tex_coord) && close(ta.y, tb.y, tolerance.tex_coord);
+	};
+
+	// Welded vertex of each original one, assigned in order of first use
+	vector<uint32_t> remap(count, UINT32_MAX);
+	vector<uint32_t> originals;
+	originals.reserve(count);
+	// Next welded vertex in the same cell
+	vector<uint32_t> next;
+	next.reserve(count);
+	for (auto& index : mesh.indices) {
+		if (index >= count) {
+			throw runtime_error("Mesh index past the last vertex");
+		}
+		if (remap[index] == UINT32_MAX) {
+			auto& p = mesh.positions[index];
+			int64_t cell[3] = { position_cell(p.x, tolerance.position), position_cell(p.y, tolerance.position),
+				position_cell(p.z, tolerance.position) };
+
+			// The earliest welded vertex within tolerance in every attribute
+			auto found = UINT32_MAX;
+			for (int dz = -reach; dz <= reach; ++dz) {
+				for (int dy = -reach; dy <= reach; ++dy) {
+					for (int dx = -reach; dx <= reach; ++dx) {
+						int64_t neighbour[3] = { cell[0] + dx, cell[1] + dy, cell[2] + dz };
+						for (auto w = table[find(neighbour)].first; w != UINT32_MAX; w = next[w]) {
+							if (w < found && matches(originals[w], index)) {
+								found = w;
+							}
+						}
+					}
+				}
+			}
+			if (found == UINT32_MAX) {
+				// A new welded vertex, at the head of its cell's list
+				found = static_cast<uint32_t>(originals.size());
+				auto slot = find(cell);
+				memcpy(table[slot].cell, cell, sizeof(cell));
+				next.push_back(table[slot].first);
+				table[slot].first = found;
+				originals.push_back(index);
+			}
+			remap[index] = found;
+		}
+		index = remap[index];
+	}
+
+	// Gather the kept vertices in their new order
+	vector<vec3> positions(originals.size()), normals(originals.size());
+	vector<vec2> tex_coords(originals.size());
+	for (size_t i = 0; i < originals.size(); ++i) {
+		positions[i] = mesh.positions[originals[i]];
+		normals[i] = mesh.normals[originals[i]];
+		tex_coords[i] = mesh.tex_coords[originals[i]];
+	}
+	mesh.positions = move(positions);
+	mesh.normals = move(normals);
+	mesh.tex_coords = move(tex_coords);
+	stats.vertices_after = originals.size();
+	return stats;
+}
+
+void optimise_overdraw(obj_data& mesh, float threshold)
+{
+	auto triangles = mesh.indices.size() / 3;
+	if (triangles < 2) {
+		return;
+	}
+	auto& indices = mesh.indices;
+
+	// FIFO cache of the same size simulate_vertex_cache uses; each vertex
+	// remembers the miss count it entered at, so a reset is just a jump in it
+	const size_t cache_size = 16;
+	vector<size_t> entered(mesh.positions.size(), 0);
+	size_t clock = cache_size + 1;
+	auto misses = [&](size_t t) {
+		unsigned int count = 0;
+		for (int k = 0; k < 3; ++k) {
+			auto v = indices[t * 3 + k];
+			if (clock - entered[v] > cache_size) {
+				entered[v] = clock++;
+				++count;
+			}
+		}
+		return count;
+	};
+	auto reset = [&]() { clock += cache_size + 1; };
+
+	// Hard boundaries where every vertex of a triangle misses
+	vector<size_t> hard;
+	for (size_t t = 0; t < triangles; ++t) {
+		if (misses(t) == 3) {
+			hard.push_back(t);
+		}
+	}
+	hard.push_back(triangles);
+
+	// Soft boundaries inside each, wherever the cluster so far is cheap enough to restart after
+	vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); ++h) {
+		auto start = hard[h], end = hard[h + 1];
+		reset();
+		size_t cluster_misses = 0;
+		for (auto t = start; t < end; ++t) {
+			cluster_misses += misses(t);
+		}
+		auto limit = threshold * static_cast<float>(cluster_misses) / (end - start);
+
+		reset();
+		clusters.push_back(start);
+		size_t running_misses = 0, running_triangles = 0;
+		for (auto t = start; t < end; ++t) {
+			running_misses += misses(t);
+			++running_triangles;
+			if (t + 1 < end && static_cast<float>(running_misses) / running_triangles <= limit) {
+				clusters.push_back(t + 1);
+				reset();
+				running_misses = running_triangles = 0;
+			}
+		}
+	}
+	clusters.push_back(triangles);
+
+	// Area weighted centre and normal of each cluster and of the whole mesh
+	auto cluster_count = clusters.size() - 1;
+	vector<vec3> centres(cluster_count, vec3(0.0f)), normals(cluster_count, vec3(0.0f));
+	vec3 mesh_centre(0.0f);
+	auto mesh_area = 0.0f;
+	for (size_t c = 0; c < cluster_count; ++c) {
+		auto area = 0.0f;
+		for (auto t = clusters[c]; t < clusters[c + 1]; ++t) {
+			auto& a = mesh.positions[indices[t * 3]];
+			auto& b = mesh.positions[indices[t * 3 + 1]];
+			auto& d = mesh.positions[indices[t * 3 + 2]];
+			auto n = cross(b - a, d - a);
+			auto triangle_area = length(n);
+			centres[c] += (a + b + d) / 3.0f * triangle_area;
+			normals[c] += n;
+			area += triangle_area;
+		}
+		mesh_centre += centres[c];
+		mesh_area += area;
+		centres[c] /= area > 0.0f ? area : 1.0f;
+	}
+	mesh_centre /= mesh_area > 0.0f ? mesh_area : 1.0f;
+
+	// Furthest out and most outward facing first
+	vector<float> keys(cluster_count);
+	vector<size_t> order(cluster_count);
+	for (size_t c = 0; c < cluster_count; ++c) {
+		auto n = normals[c];
+		keys[c] = dot(n, n) > 0.0f ? dot(centres[c] - mesh_centre, normalize(n)) : 0.0f;
+		order[c] = c;
+	}
+	stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+	vector<uint32_t> sorted;
+	sorted.reserve(indices.size());
+	for (auto c : order) {
+		sorted.insert(sorted.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	indices = move(sorted);
+}
+
+void optimise_vertex_fetch(obj_data& mesh)
+{
+	auto count = mesh.positions.size();
+	vector<uint32_t> remap(count, UINT32_MAX);
+	vector<uint32_t> originals;
+	originals.reserve(count);
+	for (auto& index : mesh.indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = static_cast<uint32_t>(originals.size());
+			originals.push_back(index);
+		}
+		index = remap[index];
+	}
+
+	// Vertices no triangle uses are dropped
+	vector<vec3> positions(originals.size()), normals(originals.size());
+	vector<vec2> tex_coords(originals.size());
+	for (size_t i = 0; i < originals.size(); ++i) {
+		positions[i] = mesh.positions[originals[i]];
+		normals[i] = mesh.normals[originals[i]];
+		tex_coords[i] = mesh.tex_coords[originals[i]];
+	}
+	mesh.positions = move(positions);
+	mesh.normals = move(normals);
+	mesh.tex_coords = move(tex_coords);
+}
+
+void optimise_mesh(obj_data& mesh)
+{
+	optimise_vertex_cache(mesh.indices.data(), mesh.indices.size(), mesh.positions.size());
+	optimise_overdraw(mesh);
+	optimise_vertex_fetch(mesh);
+}
+
+double measure_overdraw(const obj_data& mesh, unsigned int resolution)
+{
+	if (mesh.positions.empty() || mesh.indices.empty()) {
+		return 1.0;
+	}
+	vec3 low = mesh.positions[0], high = mesh.positions[0];
+	for (auto& p : mesh.positions) {
+		low = min(low, p);
+		high = max(high, p);
+	}
+	auto extent = std::max(std::max(high.x - low.x, high.y - low.y), std::max(high.z - low.z, 1e-12f));
+	auto scale = (resolution - 1) / extent;
+
+	size_t shaded = 0, covered = 0;
+	vector<float> depth(static_cast<size_t>(resolution) * resolution);
+	for (int view = 0; view < 6; ++view) {
+		// Looking along +/- each axis; the other two axes are the screen
+		auto axis = view / 2;
+		auto sign = view % 2 == 0 ? 1.0f : -1.0f;
+		auto u_axis = (axis + 1) % 3, v_axis = (axis + 2) % 3;
+		vec3 direction(0.0f);
+		direction[axis] = sign;
+		fill(depth.begin(), depth.end(), numeric_limits<float>::max());
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			vec3 p[3];
+			for (int k = 0; k < 3; ++k) {
+				p[k] = mesh.positions[mesh.indices[i + k]];
+			}
+			// Back faces are culled
+			if (dot(cross(p[1] - p[0], p[2] - p[0]), direction) >= 0.0f) {
+				continue;
+			}
+			vec3 s[3];
+			for (int k = 0; k < 3; ++k) {
+				s[k] = vec3((p[k][u_axis] - low[u_axis]) * scale, (p[k][v_axis] - low[v_axis]) * scale,
+					p[k][axis] * sign);
+			}
+			auto area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+			if (area == 0.0f) {
+				continue;
+			}
+			auto x0 = static_cast<int>(std::max(std::min(std::min(s[0].x, s[1].x), s[2].x), 0.0f));
+			auto y0 = static_cast<int>(std::max(std::min(std::min(s[0].y, s[1].y), s[2].y), 0.0f));
+			auto x1 = std::min(static_cast<int>(std::max(std::max(s[0].x, s[1].x), s[2].x)), static_cast<int>(resolution) - 1);
+			auto y1 = std::min(static_cast<int>(std::max(std::max(s[0].y, s[1].y), s[2].y)), static_cast<int>(resolution) - 1);
+			for (auto y = y0; y <= y1; ++y) {
+				for (auto x = x0; x <= x1; ++x) {
+					// Barycentric weights of the pixel centre
+					auto px = x + 0.5f, py = y + 0.5f;
+					auto w0 = ((s[1].x - px) * (s[2].y - py) - (s[1].y - py) * (s[2].x - px)) / area;
+					auto w1 = ((s[2].x - px) * (s[0].y - py) - (s[2].y - py) * (s[0].x - px)) / area;
+					auto w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+						continue;
+					}
+					auto z = w0 * s[0].z + w1 * s[1].z + w2 * s[2].z;
+					auto& stored = depth[static_cast<size_t>(y) * resolution + x];
+					if (z < stored) {
+						stored = z;
+						++shaded;
+					}
+				}
+			}
+		}
+		for (auto d : depth) {
+			covered += d < numeric_limits<float>::max() ? 1 : 0;
+		}
+	}
+	return covered ? static_cast<double>(shaded) / covered : 1.0;
+}
+
+namespace
+{
+	// Bounds of the triangles in indices[first, first + count)
+	mesh_cluster bound_cluster(const obj_data& mesh, size_t first, size_t count)
+	{
+		mesh_cluster cluster = { static_cast<uint32_t>(first), static_cast<uint32_t>(count), vec3(0.0f), 0.0f,
+			vec3(0.0f), 2.0f };
+		auto begin = mesh.indices.data() + first, end = begin + count;
+
+		// Ritter's sphere: span the two points furthest apart along a sweep, then
+		// grow it over anything left outside
+		auto furthest = [&](const vec3& from) {
+			auto best = mesh.positions[*begin];
+			auto best_distance = -1.0f;
+			for (auto i = begin; i != end; ++i) {
+				auto d = distance(from, mesh.positions[*i]);
+				if (d > best_distance) {
+					best = mesh.positions[*i];
+					best_distance = d;
+				}
+			}
+			return best;
+		};
+		auto a = furthest(mesh.positions[*begin]);
+		auto b = furthest(a);
+		cluster.centre = (a + b) * 0.5f;
+		cluster.radius = distance(a, b) * 0.5f;
+		for (auto i = begin; i != end; ++i) {
+			auto& p = mesh.positions[*i];
+			auto d = distance(cluster.centre, p);
+			if (d > cluster.radius) {
+				auto grown = (cluster.radius + d) * 0.5f;
+				cluster.centre += (p - cluster.centre) * ((grown - cluster.radius) / d);
+				cluster.radius = grown;
+			}
+		}
+
+		// Normal cone around the mean face normal; degenerate faces face nowhere
+		vector<vec3> normals;
+		normals.reserve(count / 3);
+		vec3 sum(0.0f);
+		for (auto i = begin; i != end; i += 3) {
+			auto n = cross(mesh.positions[i[1]] - mesh.positions[i[0]], mesh.positions[i[2]] - mesh.positions[i[0]]);
+			auto area = length(n);
+			if (area > 0.0f) {
+				normals.push_back(n / area);
+				sum += normals.back();
+			}
+		}
+		auto sum_length = length(sum);
+		if (normals.empty() || sum_length < 1e-6f) {
+			return cluster;
+		}
+		cluster.cone_axis = sum / sum_length;
+		auto spread = 1.0f;
+		for (auto& n : normals) {
+			spread = std::min(spread, dot(n, cluster.cone_axis));
+		}
+		// Faces at right angles to the axis or beyond leave no direction it all faces away from
+		if (spread > 0.0f) {
+			cluster.cone_cutoff = sqrt(std::max(1.0f - spread * spread, 0.0f));
+		}
+		return cluster;
+	}
+}
+
+void build_clusters(obj_data& mesh, size_t max_vertices, size_t max_triangles)
+{
+	mesh.clusters.clear();
+	auto lods = mesh.lods;
+	if (lods.empty()) {
+		lods.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0.0f });
+	}
+	max_vertices = std::max<size_t>(max_vertices, 3);
+	max_triangles = std::max<size_t>(max_triangles, 1);
+
+	// Vertices sharing a position go through their first copy, so clusters
+	// grow across normal and texture seams
+	auto vertex_count = mesh.positions.size();
+	vector<uint32_t> order(vertex_count), canonical(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		order[v] = static_cast<uint32_t>(v);
+	}
+	auto less_position = [&](uint32_t a, uint32_t b) {
+		auto& pa = mesh.positions[a];
+		auto& pb = mesh.positions[b];
+		return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+	};
+	sort(order.begin(), order.end(), less_position);
+	for (size_t i = 0; i < vertex_count; ++i) {
+		canonical[order[i]] = i > 0 && !less_position(order[i - 1], order[i]) ? canonical[order[i - 1]] : order[i];
+	}
+
+	// Cluster each vertex last joined, so each is counted once per cluster, and
+	// its number within that cluster
+	vector<uint32_t> stamp(vertex_count, UINT32_MAX), canonical_position(vertex_count);
+	vector<uint32_t> reordered;
+	for (auto& lod : lods) {
+		auto indices = mesh.indices.data() + lod.first;
+		auto triangles = lod.count / 3;
+
+		// Triangles around each vertex, and each triangle's unit normal
+		vector<uint32_t> offsets(vertex_count + 1, 0), adjacent(triangles * 3);
+		for (size_t i = 0; i < triangles * 3; ++i) {
+			++offsets[canonical[indices[i]] + 1];
+		}
+		for (size_t v = 0; v < vertex_count; ++v) {
+			offsets[v + 1] += offsets[v];
+		}
+		auto fill = offsets;
+		vector<vec3> normals(triangles);
+		for (uint32_t t = 0; t < triangles; ++t) {
+			auto tri = indices + t * 3;
+			for (size_t k = 0; k < 3; ++k) {
+				adjacent[fill[canonical[tri[k]]]++] = t;
+			}
+			auto n = cross(mesh.positions[tri[1]] - mesh.positions[tri[0]], mesh.positions[tri[2]] - mesh.positions[tri[0]]);
+			auto area = length(n);
+			normals[t] = area > 0.0f ? n / area : vec3(0.0f);
+		}
+
+		// Grows each cluster from the earliest triangle left, taking the neighbour
+		// adding fewest vertices and then the one facing most like the cluster, so
+		// the normal cones stay narrow
+		vector<bool> emitted(triangles, false);
+		vector<uint32_t> members, local;
+		// Each cluster's start in reordered, and its centre and summed face normal
+		vector<size_t> starts;
+		vector<vec3> centres, facings;
+		vec3 mesh_centre(0.0f);
+		size_t seed = 0;
+		while (true) {
+			while (seed < triangles && emitted[seed]) {
+				++seed;
+			}
+			if (seed == triangles) {
+				break;
+			}
+			auto id = static_cast<uint32_t>(mesh.clusters.size() + starts.size());
+			members.clear();
+			local.clear();
+			size_t triangle_count = 0;
+			vec3 centre(0.0f), facing(0.0f);
+			auto next = static_cast<uint32_t>(seed);
+			while (next != UINT32_MAX) {
+				emitted[next] = true;
+				++triangle_count;
+				facing += normals[next];
+				for (size_t k = 0; k < 3; ++k) {
+					auto v = indices[next * 3 + k];
+					centre += mesh.positions[v];
+					if (stamp[v] != id) {
+						stamp[v] = id;
+						members.push_back(v);
+					}
+					local.push_back(v);
+				}
+				if (triangle_count == max_triangles) {
+					break;
+				}
+
+				next = UINT32_MAX;
+				auto best_added = 3;
+				auto best_facing = -2.0f;
+				auto axis = length(facing) > 0.0f ? normalize(facing) : facing;
+				for (auto m : members) {
+					auto v = canonical[m];
+					for (auto a = offsets[v]; a < offsets[v + 1]; ++a) {
+						auto t = adjacent[a];
+						if (emitted[t]) {
+							continue;
+						}
+						auto added = 0;
+						for (size_t k = 0; k < 3; ++k) {
+							added += stamp[indices[t * 3 + k]] != id;
+						}
+						auto f = dot(normals[t], axis);
+						if (members.size() + added <= max_vertices && f >= 0.0f &&
+							(added < best_added || (added == best_added && f > best_facing))) {
+							next = t;
+							best_added = added;
+							best_facing = f;
+						}
+					}
+				}
+			}
+
+			// Growth order is poor for the vertex cache, so the cluster is ordered
+			// again over its own vertices, numbered by position in members
+			for (size_t m = 0; m < members.size(); ++m) {
+				canonical_position[members[m]] = static_cast<uint32_t>(m);
+			}
+			for (auto& v : local) {
+				v = canonical_position[v];
+			}
+			optimise_vertex_cache(local.data(), local.size(), members.size());
+			starts.push_back(reordered.size());
+			for (auto v : local) {
+				reordered.push_back(members[v]);
+			}
+			mesh_centre += centre;
+			centres.push_back(centre / (triangle_count * 3.0f));
+			facings.push_back(facing);
+		}
+		starts.push_back(reordered.size());
+
+		// Clusters facing out from the middle of the mesh first, as optimise_overdraw orders them
+		mesh_centre /= triangles * 3.0f;
+		vector<float> keys(centres.size());
+		vector<size_t> sorted(centres.size());
+		for (size_t c = 0; c < sorted.size(); ++c) {
+			auto& n = facings[c];
+			keys[c] = dot(n, n) > 0.0f ? dot(centres[c] - mesh_centre, normalize(n)) : 0.0f;
+			sorted[c] = c;
+		}
+		stable_sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+		auto out = mesh.indices.begin() + lod.first;
+		for (auto c : sorted) {
+			auto count = static_cast<uint32_t>(starts[c + 1] - starts[c]);
+			mesh.clusters.push_back({ static_cast<uint32_t>(out - mesh.indices.begin()), count, vec3(0.0f), 0.0f,
+				vec3(0.0f), 2.0f });
+			out = copy(reordered.begin() + starts[c], reordered.begin() + starts[c + 1], out);
+		}
+		reordered.clear();
+	}
+
+	// Bounded once every level's indices are in their new order
+	for (auto& cluster : mesh.clusters) {
+		cluster = bound_cluster(mesh, cluster.first, cluster.count);
+	}
+}
+
+bool cluster_faces_away(const mesh_cluster& cluster, const vec3& eye)
+{
+	// Every point p of the sphere then has dot(p - eye, axis) >= cutoff * |p - eye|,
+	// which puts the view direction to p within 90 degrees of every face normal
+	auto to_centre = cluster.centre - eye;
+	return dot(to_centre, cluster.cone_axis) >=
+		cluster.cone_cutoff * length(to_centre) + cluster.radius * (1.0f + cluster.cone_cutoff);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+
+#include "obj_loader.h"
+#include "vertex_cache.h"
+
+// How far apart each component of two vertices' attributes may be and still be
+// welded into one; 0 merges only exact copies.
+struct weld_tolerance
+{
+	float position = 1e-6f;
+	float normal = 1e-3f;
+	float tex_coord = 1e-5f;
+};
+
+// Vertex counts either side of a weld
+struct weld_stats
+{
+	size_t vertices_before = 0;
+	size_t vertices_after = 0;
+};
+
+// Merges duplicate vertices of mesh and rewrites its indices to match.  A mesh
+// with no indices is taken as a plain triangle list and gains them.  Each
+// merged vertex keeps the attributes of its first copy, and vertices stay in
+// order of first use.  A vertex is merged into the earliest kept vertex whose
+// attributes are all within tolerance of its own.
+weld_stats weld_mesh(obj_data& mesh, const weld_tolerance& tolerance = weld_tolerance());
+
+// Splits an index list already ordered for the vertex cache into clusters
+// where the cache would restart anyway, or where splitting costs no more than
+// threshold times the cluster's ACMR, then draws the clusters facing out from
+// the middle of the mesh first.  They are the ones most likely to hide the
+// rest from any side, so fewer hidden pixels are shaded without needing to
+// know the view.
+void optimise_overdraw(obj_data& mesh, float threshold = 1.05f);
+
+// Renumbers vertices in the order the indices first use them, so drawing
+// walks the vertex buffers forwards
+void optimise_vertex_fetch(obj_data& mesh);
+
+// Runs optimise_vertex_cache, optimise_overdraw and optimise_vertex_fetch in
+// turn on a welded, indexed mesh
+void optimise_mesh(obj_data& mesh);
+
+// Shaded pixels per covered pixel when the mesh is drawn in index order with
+// a depth test and back face culling, averaged over six views along the axes
+// at the given resolution; 1.0 means nothing is shaded twice
+double measure_overdraw(const obj_data& mesh, unsigned int resolution = 256);
+
+// Splits every level of detail of mesh into clusters of no more than
+// max_vertices vertices and max_triangles triangles, each grown across
+// neighbouring triangles facing within 90 degrees of it, and bounds each with
+// a sphere and a normal cone for culling.  The indices of each level are
+// rewritten cluster by cluster, each ordered for the vertex cache and the
+// clusters facing out from the middle first, as optimise_mesh leaves them.
+// Run last, after build_lod_chain.
+void build_clusters(obj_data& mesh, size_t max_vertices = 64, size_t max_triangles = 124);
+
+// Whether every face of cluster faces away from an eye at eye, in the mesh's
+// space, so none can be seen with back faces culled
+bool cluster_faces_away(const mesh_cluster& cluster, const glm::vec3& eye);
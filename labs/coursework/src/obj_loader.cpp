@@ -0,0 +1,386 @@
+#include "obj_loader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "mapped_file.h"
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+	// Face corner as written in the file.  Indices are 0-based once resolved;
+	// those marked relative are counted from the start of their chunk until the
+	// chunk's place in the file is known.  -1 marks a missing attribute.
+	struct corner
+	{
+		int32_t index[3];
+		uint32_t relative;
+	};
+
+	// Everything parsed from one line aligned chunk of the file
+	struct obj_chunk
+	{
+		vector<vec3> positions;
+		vector<vec2> tex_coords;
+		vector<vec3> normals;
+		vector<corner> corners;
+		// Corners in each face
+		vector<uint32_t> face_sizes;
+		// Start of the first malformed line, set instead of throwing so every chunk finishes
+		const char* error = nullptr;
+	};
+
+	const double powers_of_ten[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool is_space(char c) { return c == ' ' || c == '\t'; }
+	inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+	const char* skip_spaces(const char* p, const char* end)
+	{
+		while (p < end && is_space(*p)) {
+			++p;
+		}
+		return p;
+	}
+
+	// Parses a signed integer after any spaces, returning nullptr if there is none
+	const char* parse_int(const char* p, const char* end, int32_t& value)
+	{
+		p = skip_spaces(p, end);
+		auto negative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+')) {
+			++p;
+		}
+		if (p == end || !is_digit(*p)) {
+			return nullptr;
+		}
+		int64_t result = 0;
+		while (p < end && is_digit(*p)) {
+			result = std::min<int64_t>(result * 10 + (*p++ - '0'), INT32_MAX);
+		}
+		value = static_cast<int32_t>(negative ? -result : result);
+		return p;
+	}
+
+	// Parses one v/vt/vn face corner, returning nullptr if it is malformed
+	const char* parse_corner(const char* p, const char* end, corner& c, const obj_chunk& chunk)
+	{
+		size_t counts[3] = { chunk.positions.size(), chunk.tex_coords.size(), chunk.normals.size() };
+		c.relative = 0;
+		for (int attribute = 0; attribute < 3; ++attribute) {
+			c.index[attribute] = -1;
+			if (attribute > 0) {
+				// v, v/vt, v//vn or v/vt/vn
+				if (p == end || *p != '/') {
+					continue;
+				}
+				++p;
+				if (p < end && *p == '/') {
+					continue;
+				}
+			}
+			int32_t value;
+			p = parse_int(p, end, value);
+			if (!p || value == 0) {
+				return nullptr;
+			}
+			if (value > 0) {
+				c.index[attribute] = value - 1;
+			} else {
+				// Counts back from the last one read, which is only known within this chunk
+				c.index[attribute] = static_cast<int32_t>(counts[attribute]) + value;
+				c.relative |= 1u << attribute;
+			}
+		}
+		return p;
+	}
+
+	void parse_chunk(const char* p, const char* end, obj_chunk& chunk)
+	{
+		while (p < end) {
+			auto line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (!line_end) {
+				line_end = end;
+			}
+			auto line = p;
+			auto stop = line_end > p && line_end[-1] == '\r' ? line_end - 1 : line_end;
+			p = line_end < end ? line_end + 1 : end;
+
+			// Keyword, then its values; anything after the values (such as a w) is ignored
+			auto keyword = skip_spaces(line, stop);
+			line = keyword;
+			while (line < stop && !is_space(*line)) {
+				++line;
+			}
+			auto length = line - keyword;
+			const char* q = nullptr;
+			if (length == 1 && keyword[0] == 'v') {
+				vec3 v;
+				(q = parse_obj_float(line, stop, v.x)) && (q = parse_obj_float(q, stop, v.y)) &&
+					(q = parse_obj_float(q, stop, v.z));
+				chunk.positions.push_back(v);
+			} else if (length == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+				vec2 t;
+				(q = parse_obj_float(line, stop, t.x)) && (q = parse_obj_float(q, stop, t.y));
+				chunk.tex_coords.push_back(t);
+			} else if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+				vec3 n;
+				(q = parse_obj_float(line, stop, n.x)) && (q = parse_obj_float(q, stop, n.y)) &&
+					(q = parse_obj_float(q, stop, n.z));
+				chunk.normals.push_back(n);
+			} else if (length == 1 && keyword[0] == 'f') {
+				uint32_t size = 0;
+				q = skip_spaces(line, stop);
+				while (q && q < stop) {
+					corner c;
+					q = parse_corner(q, stop, c, chunk);
+					if (q) {
+						chunk.corners.push_back(c);
+						++size;
+						q = skip_spaces(q, stop);
+					}
+				}
+				if (q && size < 3) {
+					q = nullptr;
+				}
+				chunk.face_sizes.push_back(size);
+			} else {
+				// Blank, a comment or a keyword this loader does not read
+				continue;
+			}
+			if (!q) {
+				chunk.error = keyword;
+				return;
+			}
+		}
+	}
+}
+
+const char* parse_obj_float(const char* p, const char* end, float& value)
+{
+	p = skip_spaces(p, end);
+	auto negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) {
+		++p;
+	}
+
+	// Up to 19 significant digits are exact in 64 bits, which is far past float
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	auto start = p;
+	for (; p < end && is_digit(*p); ++p) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa ? 1 : 0;
+		} else {
+			++exponent;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (++p; p < end && is_digit(*p); ++p) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa ? 1 : 0;
+				--exponent;
+			}
+		}
+	}
+	if (p == start || (p == start + 1 && *start == '.')) {
+		return nullptr;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int32_t power;
+		auto q = p + 1 < end && !is_space(p[1]) ? parse_int(p + 1, end, power) : nullptr;
+		if (!q) {
+			return nullptr;
+		}
+		exponent += std::max(std::min(power, 400), -400);
+		p = q;
+	}
+
+	auto result = static_cast<double>(mantissa);
+	while (exponent > 22) {
+		result *= 1e22;
+		exponent -= 22;
+	}
+	while (exponent < -22) {
+		result /= 1e22;
+		exponent += 22;
+	}
+	result = exponent >= 0 ? result * powers_of_ten[exponent] : result / powers_of_ten[-exponent];
+	value = static_cast<float>(negative ? -result : result);
+	return p;
+}
+
+void parse_obj(const char* data, size_t size, obj_data& out, thread_pool& pool, const string& name)
+{
+	auto end = data + size;
+
+	// Split into chunks of at least 64KB, each starting at the beginning of a line
+	const size_t min_chunk = 64 * 1024;
+	auto chunk_count = std::max<size_t>(std::min<size_t>((pool.size() + 1) * 4, size / min_chunk), 1);
+	vector<const char*> bounds(chunk_count + 1, end);
+	bounds[0] = data;
+	for (size_t i = 1; i < chunk_count; ++i) {
+		auto p = std::max(data + size * i / chunk_count, bounds[i - 1]);
+		auto line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+		bounds[i] = line_end ? line_end + 1 : end;
+	}
+
+	vector<obj_chunk> chunks(chunk_count);
+	pool.parallel_for(0, chunk_count, [&](size_t begin, size_t finish) {
+		for (auto i = begin; i < finish; ++i) {
+			parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+		}
+	});
+
+	// Where each chunk's attributes, corners and faces start in the whole file
+	struct chunk_base
+	{
+		size_t positions, tex_coords, normals, corners, faces;
+	};
+	vector<chunk_base> bases(chunk_count + 1);
+	for (size_t i = 0; i < chunk_count; ++i) {
+		auto& chunk = chunks[i];
+		if (chunk.error) {
+			auto line = count(data, chunk.error, '\n') + 1;
+			throw runtime_error("Malformed line " + to_string(line) + " in " + name);
+		}
+		bases[i + 1].positions = bases[i].positions + chunk.positions.size();
+		bases[i + 1].tex_coords = bases[i].tex_coords + chunk.tex_coords.size();
+		bases[i + 1].normals = bases[i].normals + chunk.normals.size();
+		bases[i + 1].corners = bases[i].corners + chunk.corners.size();
+		bases[i + 1].faces = bases[i].faces + chunk.face_sizes.size();
+	}
+	auto& total = bases[chunk_count];
+	if (total.positions > INT32_MAX || total.tex_coords > INT32_MAX || total.normals > INT32_MAX) {
+		throw runtime_error(name + " has too many vertices");
+	}
+
+	// Gather every chunk into whole file arrays and resolve relative indices
+	vector<vec3> positions(total.positions), normals(total.normals);
+	vector<vec2> tex_coords(total.tex_coords);
+	vector<corner> corners(total.corners);
+	vector<uint32_t> face_sizes(total.faces);
+	auto missing_normals = false;
+	pool.parallel_for(0, chunk_count, [&](size_t begin, size_t finish) {
+		for (auto i = begin; i < finish; ++i) {
+			auto& chunk = chunks[i];
+			auto& base = bases[i];
+			copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + base.positions);
+			copy(chunk.tex_coords.begin(), chunk.tex_coords.end(), tex_coords.begin() + base.tex_coords);
+			copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + base.normals);
+			copy(chunk.face_sizes.begin(), chunk.face_sizes.end(), face_sizes.begin() + base.faces);
+			size_t chunk_starts[3] = { base.positions, base.tex_coords, base.normals };
+			size_t counts[3] = { total.positions, total.tex_coords, total.normals };
+			auto target = corners.begin() + base.corners;
+			for (auto c : chunk.corners) {
+				for (int attribute = 0; attribute < 3; ++attribute) {
+					if (c.relative & (1u << attribute)) {
+						c.index[attribute] += static_cast<int32_t>(chunk_starts[attribute]);
+						if (c.index[attribute] < 0) {
+							throw runtime_error(name + " has a relative index before the first vertex");
+						}
+					} else if (c.index[attribute] >= static_cast<int64_t>(counts[attribute])) {
+						throw runtime_error(name + " has an index past the last vertex");
+					}
+				}
+				*target++ = c;
+			}
+			// Freed as it goes, so the parsed and merged copies are not both held
+			chunk = obj_chunk();
+		}
+	});
+
+	// One vertex per distinct corner, found with an open addressing hash table
+	// over the three indices
+	size_t capacity = 16;
+	while (capacity < corners.size() * 2) {
+		capacity *= 2;
+	}
+	vector<uint32_t> table(capacity, UINT32_MAX);
+	vector<const corner*> vertices;
+	vertices.reserve(corners.size() / 2);
+	vector<uint32_t> corner_vertices(corners.size());
+	for (size_t i = 0; i < corners.size(); ++i) {
+		auto& c = corners[i];
+		auto hash = static_cast<uint64_t>(static_cast<uint32_t>(c.index[0])) * 0x9e3779b97f4a7c15ull ^
+			static_cast<uint64_t>(static_cast<uint32_t>(c.index[1])) * 0xc2b2ae3d27d4eb4full ^
+			static_cast<uint64_t>(static_cast<uint32_t>(c.index[2])) * 0x165667b19e3779f9ull;
+		auto slot = static_cast<size_t>(hash >> 32) & (capacity - 1);
+		while (table[slot] != UINT32_MAX) {
+			auto other = vertices[table[slot]];
+			if (other->index[0] == c.index[0] && other->index[1] == c.index[1] && other->index[2] == c.index[2]) {
+				break;
+			}
+			slot = (slot + 1) & (capacity - 1);
+		}
+		if (table[slot] == UINT32_MAX) {
+			table[slot] = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(&c);
+			missing_normals |= c.index[2] < 0;
+		}
+		corner_vertices[i] = table[slot];
+	}
+	table = vector<uint32_t>();
+
+	// Fan out each polygon from its first corner
+	out.indices.clear();
+	out.lods.clear();
+	out.indices.reserve((corners.size() - face_sizes.size() * 2) * 3);
+	size_t first = 0;
+	for (auto face_size : face_sizes) {
+		for (uint32_t k = 2; k < face_size; ++k) {
+			out.indices.insert(out.indices.end(), {
+				corner_vertices[first], corner_vertices[first + k - 1], corner_vertices[first + k]
+			});
+		}
+		first += face_size;
+	}
+
+	// Faces without normals are shaded smooth, summing the area weighted normal
+	// of every triangle around each position
+	vector<vec3> smooth;
+	if (missing_normals) {
+		smooth.assign(positions.size(), vec3(0.0f));
+		for (size_t i = 0; i < out.indices.size(); i += 3) {
+			auto a = vertices[out.indices[i]]->index[0];
+			auto b = vertices[out.indices[i + 1]]->index[0];
+			auto c = vertices[out.indices[i + 2]]->index[0];
+			auto n = cross(positions[b] - positions[a], positions[c] - positions[a]);
+			smooth[a] += n;
+			smooth[b] += n;
+			smooth[c] += n;
+		}
+	}
+
+	// Vertex buffers from the distinct corners
+	out.positions.resize(vertices.size());
+	out.normals.resize(vertices.size());
+	out.tex_coords.resize(vertices.size());
+	pool.parallel_for(0, vertices.size(), [&](size_t begin, size_t finish) {
+		for (auto i = begin; i < finish; ++i) {
+			auto& c = *vertices[i];
+			out.positions[i] = positions[c.index[0]];
+			out.tex_coords[i] = c.index[1] >= 0 ? tex_coords[c.index[1]] : vec2(0.0f);
+			if (c.index[2] >= 0) {
+				out.normals[i] = normals[c.index[2]];
+			} else {
+				auto n = smooth[c.index[0]];
+				out.normals[i] = dot(n, n) > 0.0f ? normalize(n) : vec3(0.0f, 1.0f, 0.0f);
+			}
+		}
+	}, 4096);
+}
+
+void load_obj(const string& filename, obj_data& out, thread_pool& pool)
+{
+	mapped_file file(filename);
+	parse_obj(file.data(), file.size(), out, pool, filename);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "thread_pool.h"
+
+// One level of detail of a mesh: a range of its index list over the shared vertices
+struct mesh_lod
+{
+	uint32_t first;
+	uint32_t count;
+	// Furthest the level's surface strays from the full mesh, in model units
+	float error;
+};
+
+// A cluster of a level of detail: a run of its indices over few enough
+// vertices to be culled as one, with bounds to cull it by
+struct mesh_cluster
+{
+	uint32_t first;
+	uint32_t count;
+	// Sphere around the cluster's vertices
+	glm::vec3 centre;
+	float radius;
+	// Mean of the cluster's face normals, and the sine of the widest angle a face
+	// normal strays from it; 1 or more when the faces spread too far to cull
+	glm::vec3 cone_axis;
+	float cone_cutoff;
+};
+
+// Indexed triangle mesh read from a Wavefront OBJ file, in the buffers geometry
+// takes (position, normal and texture coordinate per vertex)
+struct obj_data
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> tex_coords;
+	// Three per triangle
+	std::vector<uint32_t> indices;
+	// Levels of detail, finest first, once build_lod_chain has run; the indices
+	// then hold every level one after another.  Empty means one level using
+	// every index.
+	std::vector<mesh_lod> lods;
+	// Clusters covering every level in index order, once build_clusters has run
+	std::vector<mesh_cluster> clusters;
+};
+
+// Reads an OBJ file by mapping it and parsing line aligned chunks of it on the
+// thread pool.  Every distinct position/texture coordinate/normal combination
+// becomes one vertex, polygons are split into fans, missing texture coordinates
+// are zero and missing normals are smoothed from the faces around each position.
+// Only v, vt, vn and f lines are read.  Throws std::runtime_error if the file
+// cannot be opened or is malformed.
+void load_obj(const std::string& filename, obj_data& out, thread_pool& pool = thread_pool::shared());
+
+// The same from OBJ text already in memory; name is used in error messages
+void parse_obj(const char* data, size_t size, obj_data& out, thread_pool& pool = thread_pool::shared(),
+	const std::string& name = "OBJ text");
+
+// Parses a decimal float (sign, digits, fraction, exponent) after any spaces or
+// tabs, without the locale lookups of strtof.  Returns the character after the
+// number, or nullptr if there is no number at p.
+const char* parse_obj_float(const char* p, const char* end, float& value);
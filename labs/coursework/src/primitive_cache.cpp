@@ -0,0 +1,91 @@
+#include "primitive_cache.h"
+
+#include "mesh_simplify.h"
+#include "mesh_tools.h"
+#include "static_primitives.h"
+
+using namespace std;
+using namespace graphics_framework;
+using namespace glm;
+
+namespace
+{
+	// Compile time tessellations, in read-only data
+	constexpr auto static_box = make_box();
+	constexpr auto static_tetrahedron = make_tetrahedron();
+	constexpr auto static_pyramid = make_pyramid();
+	constexpr auto static_disk = make_disk<20>();
+	constexpr auto static_cylinder = make_cylinder<20, 20>();
+}
+
+gpu_mesh weld_geometry(const geometry& geom, bool optimise)
+{
+	auto data = read_geometry(geom);
+	weld_mesh(data);
+	if (optimise) {
+		optimise_mesh(data);
+		build_lod_chain(data);
+		build_clusters(data);
+	}
+	return gpu_mesh(data, gpu_mesh::vertex_layout::split, gpu_mesh::vertex_format::packed);
+}
+
+shared_ptr<gpu_mesh> primitive_cache::box(const vec3& dims)
+{
+	// Scaling along the axes leaves the box's faces facing the same way
+	return get({ "box", { dims.x, dims.y, dims.z } }, [&]() { return gpu_mesh(static_box.view(), dims); });
+}
+
+shared_ptr<gpu_mesh> primitive_cache::tetrahedron(const vec3& dims)
+{
+	return get({ "tetrahedron", { dims.x, dims.y, dims.z } }, [&]() {
+		return dims.x == dims.y && dims.y == dims.z ? gpu_mesh(static_tetrahedron.view(), dims)
+													: weld_geometry(geometry_builder::create_tetrahedron(dims));
+	});
+}
+
+shared_ptr<gpu_mesh> primitive_cache::pyramid(const vec3& dims)
+{
+	return get({ "pyramid", { dims.x, dims.y, dims.z } }, [&]() {
+		return dims.x == dims.y && dims.y == dims.z ? gpu_mesh(static_pyramid.view(), dims)
+													: weld_geometry(geometry_builder::create_pyramid(dims));
+	});
+}
+
+shared_ptr<gpu_mesh> primitive_cache::disk(unsigned int slices, const vec2& dims)
+{
+	return get({ "disk", { static_cast<float>(slices), dims.x, dims.y } }, [&]() {
+		return slices == 20 ? gpu_mesh(static_disk.view(), vec3(dims.x, 1.0f, dims.y))
+							: weld_geometry(geometry_builder::create_disk(slices, dims));
+	});
+}
+
+shared_ptr<gpu_mesh> primitive_cache::cylinder(unsigned int stacks, unsigned int slices, const vec3& dims)
+{
+	// The side's normals survive any height, but only a round cross section
+	return get({ "cylinder", { static_cast<float>(stacks), static_cast<float>(slices), dims.x, dims.y, dims.z } },
+		[&]() {
+			return stacks == 20 && slices == 20 && dims.x == dims.z
+				? gpu_mesh(static_cylinder.view(), dims)
+				: weld_geometry(geometry_builder::create_cylinder(stacks, slices, dims));
+		});
+}
+
+shared_ptr<gpu_mesh> primitive_cache::sphere(unsigned int stacks, unsigned int slices, const vec3& dims)
+{
+	return get({ "sphere", { static_cast<float>(stacks), static_cast<float>(slices), dims.x, dims.y, dims.z } },
+		[&]() { return weld_geometry(geometry_builder::create_sphere(stacks, slices, dims)); });
+}
+
+shared_ptr<gpu_mesh> primitive_cache::torus(unsigned int stacks, unsigned int slices, float ring_radius,
+	float outer_radius)
+{
+	return get({ "torus", { static_cast<float>(stacks), static_cast<float>(slices), ring_radius, outer_radius } },
+		[&]() { return weld_geometry(geometry_builder::create_torus(stacks, slices, ring_radius, outer_radius)); });
+}
+
+shared_ptr<gpu_mesh> primitive_cache::plane(unsigned int width, unsigned int depth)
+{
+	return get({ "plane", { static_cast<float>(width), static_cast<float>(depth) } },
+		[&]() { return weld_geometry(geometry_builder::create_plane(width, depth)); });
+}
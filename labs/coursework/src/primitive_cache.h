@@ -0,0 +1,61 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <graphics_framework.h>
+
+#include "gpu_mesh.h"
+
+// Welds a geometry built by the framework into an indexed mesh, optimising,
+// simplifying and clustering it if asked, and uploads it packed
+gpu_mesh weld_geometry(const graphics_framework::geometry& geom, bool optimise = true);
+
+// The framework's geometry_builder primitives as shared gpu_meshes, one for
+// each primitive and set of parameters.  Fixed resolution shapes come from the
+// compile time tables in static_primitives.h.  Build on the main thread.
+class primitive_cache
+{
+public:
+	// A primitive's builder name and its parameters in order
+	using key = std::pair<std::string, std::vector<float>>;
+
+private:
+	std::map<key, std::shared_ptr<gpu_mesh>> _meshes;
+	// Requests answered from the cache
+	size_t _hits = 0;
+
+	// The mesh for k, made by make on first request
+	template <typename Make>
+	std::shared_ptr<gpu_mesh> get(const key& k, Make make)
+	{
+		auto found = _meshes.find(k);
+		if (found != _meshes.end()) {
+			++_hits;
+			return found->second;
+		}
+		auto built = std::make_shared<gpu_mesh>(make());
+		_meshes.emplace(k, built);
+		return built;
+	}
+
+public:
+	// Parameters and defaults as geometry_builder's
+	std::shared_ptr<gpu_mesh> box(const glm::vec3& dims = glm::vec3(1.0f));
+	std::shared_ptr<gpu_mesh> tetrahedron(const glm::vec3& dims = glm::vec3(1.0f));
+	std::shared_ptr<gpu_mesh> pyramid(const glm::vec3& dims = glm::vec3(1.0f));
+	std::shared_ptr<gpu_mesh> disk(unsigned int slices = 10, const glm::vec2& dims = glm::vec2(1.0f));
+	std::shared_ptr<gpu_mesh> cylinder(unsigned int stacks = 10, unsigned int slices = 10,
+		const glm::vec3& dims = glm::vec3(1.0f));
+	std::shared_ptr<gpu_mesh> sphere(unsigned int stacks = 10, unsigned int slices = 10,
+		const glm::vec3& dims = glm::vec3(1.0f));
+	std::shared_ptr<gpu_mesh> torus(unsigned int stacks = 10, unsigned int slices = 10, float ring_radius = 1.0f,
+		float outer_radius = 2.0f);
+	std::shared_ptr<gpu_mesh> plane(unsigned int width = 100, unsigned int depth = 100);
+
+	// Distinct primitives built, and requests that reused one
+	size_t size() const { return _meshes.size(); }
+	size_t hits() const { return _hits; }
+};
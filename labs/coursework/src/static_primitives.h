@@ -0,0 +1,345 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "vertex_packing.h"
+
+// Fixed resolution primitives tessellated at compile time.  Every make_ function
+// is constexpr, so a constexpr variable holding its result is built by the
+// compiler into read-only data: welded, indexed and already in gpu_mesh's packed
+// vertex format, ready to upload straight from static storage with no work at
+// startup.  Shapes are one unit across and centred on the origin, like the
+// framework's geometry_builder defaults; gpu_mesh scales them when uploading.
+
+// Streams of a static mesh of any size, as gpu_mesh uploads them
+struct static_mesh_view
+{
+	size_t vertex_count;
+	// 16-bit fractions of the bounding box, padded to 8 bytes
+	const uint16_t (*positions)[4];
+	const packed_attributes* attributes;
+	size_t index_count;
+	const uint32_t* indices;
+	const float* bounds_min;
+	const float* bounds_max;
+};
+
+// A mesh packed at compile time
+template <size_t Vertices, size_t Indices>
+struct static_mesh
+{
+	uint16_t positions[Vertices][4];
+	packed_attributes attributes[Vertices];
+	uint32_t indices[Indices];
+	float bounds_min[3];
+	float bounds_max[3];
+
+	constexpr static_mesh_view view() const
+	{
+		return { Vertices, positions, attributes, Indices, indices, bounds_min, bounds_max };
+	}
+};
+
+namespace compile_time
+{
+	constexpr double pi = 3.14159265358979323846;
+
+	struct dvec3
+	{
+		double x, y, z;
+	};
+
+	constexpr dvec3 operator+(const dvec3& a, const dvec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	constexpr dvec3 operator-(const dvec3& a, const dvec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	constexpr dvec3 operator*(const dvec3& a, double s) { return { a.x * s, a.y * s, a.z * s }; }
+	constexpr double dot(const dvec3& a, const dvec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	constexpr dvec3 cross(const dvec3& a, const dvec3& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	constexpr double abs(double x) { return x < 0.0 ? -x : x; }
+
+	// Nearest integer, halves away from zero as std::round
+	constexpr double round(double x)
+	{
+		return x < 0.0 ? -static_cast<double>(static_cast<int64_t>(0.5 - x))
+					   : static_cast<double>(static_cast<int64_t>(x + 0.5));
+	}
+
+	// Nearest integer, halves to even as the FPU rounds
+	constexpr double round_even(double x)
+	{
+		auto r = round(x);
+		if (abs(x - static_cast<int64_t>(x)) == 0.5 && static_cast<int64_t>(r) % 2 != 0) {
+			r -= x < 0.0 ? -1.0 : 1.0;
+		}
+		return r;
+	}
+
+	constexpr double sqrt(double x)
+	{
+		if (x <= 0.0) {
+			return 0.0;
+		}
+		auto r = x < 1.0 ? 1.0 : x;
+		for (int i = 0; i < 64; ++i) {
+			r = 0.5 * (r + x / r);
+		}
+		return r;
+	}
+
+	// Taylor series after reducing x to [-pi, pi], good to double precision
+	constexpr double sin(double x)
+	{
+		x -= 2.0 * pi * round(x / (2.0 * pi));
+		double term = x, sum = x;
+		for (int n = 1; n < 20; ++n) {
+			term *= -x * x / ((2 * n) * (2 * n + 1));
+			sum += term;
+		}
+		return sum;
+	}
+
+	constexpr double cos(double x) { return sin(x + 0.5 * pi); }
+
+	constexpr dvec3 normalize(const dvec3& v) { return v * (1.0 / sqrt(dot(v, v))); }
+
+	// Bits of the nearest half precision float, as to_half gives them, for the
+	// finite values texture coordinates take
+	constexpr uint16_t half_bits(double value)
+	{
+		uint16_t sign = value < 0.0 ? 0x8000 : 0;
+		value = abs(value);
+		if (value == 0.0) {
+			return sign;
+		}
+		// Below the smallest normal half the steps are 2^-24 apart
+		if (value < 1.0 / 16384.0) {
+			return static_cast<uint16_t>(sign | static_cast<uint16_t>(round_even(value * 16777216.0)));
+		}
+		int exponent = 0;
+		while (value >= 2.0) {
+			value /= 2.0;
+			++exponent;
+		}
+		while (value < 1.0) {
+			value *= 2.0;
+			--exponent;
+		}
+		auto mantissa = static_cast<int>(round_even((value - 1.0) * 1024.0));
+		if (mantissa == 1024) {
+			mantissa = 0;
+			++exponent;
+		}
+		return static_cast<uint16_t>(sign | ((exponent + 15) << 10) | mantissa);
+	}
+
+	// The same octahedral coordinates as encode_octahedral
+	constexpr packed_attributes pack_attributes(const dvec3& normal, double u, double v)
+	{
+		packed_attributes packed = {};
+		auto sum = abs(normal.x) + abs(normal.y) + abs(normal.z);
+		if (sum > 0.0) {
+			auto x = normal.x / sum, y = normal.y / sum;
+			if (normal.z < 0.0) {
+				auto folded_x = (1.0 - abs(y)) * (x >= 0.0 ? 1.0 : -1.0);
+				auto folded_y = (1.0 - abs(x)) * (y >= 0.0 ? 1.0 : -1.0);
+				x = folded_x;
+				y = folded_y;
+			}
+			packed.normal[0] = static_cast<int16_t>(round(x * 32767.0));
+			packed.normal[1] = static_cast<int16_t>(round(y * 32767.0));
+		}
+		packed.tex_coord[0] = half_bits(u);
+		packed.tex_coord[1] = half_bits(v);
+		return packed;
+	}
+
+	// Gathers a mesh's vertices and triangles in double precision, then packs
+	// them.  Writing past either count, or packing before both are full, stops
+	// the compile.
+	template <size_t Vertices, size_t Indices>
+	class builder
+	{
+	private:
+		dvec3 _positions[Vertices] = {};
+		dvec3 _normals[Vertices] = {};
+		double _tex_coords[Vertices][2] = {};
+		uint32_t _indices[Indices] = {};
+		size_t _vertex_count = 0;
+		size_t _index_count = 0;
+
+	public:
+		constexpr uint32_t vertex(const dvec3& position, const dvec3& normal, double u, double v)
+		{
+			_positions[_vertex_count] = position;
+			_normals[_vertex_count] = normal;
+			_tex_coords[_vertex_count][0] = u;
+			_tex_coords[_vertex_count][1] = v;
+			return static_cast<uint32_t>(_vertex_count++);
+		}
+
+		constexpr void triangle(uint32_t a, uint32_t b, uint32_t c)
+		{
+			_indices[_index_count++] = a;
+			_indices[_index_count++] = b;
+			_indices[_index_count++] = c;
+		}
+
+		// A flat triangle wound to face away from centre
+		constexpr void face(const dvec3& a, dvec3 b, dvec3 c, const dvec3& centre)
+		{
+			if (dot(cross(b - a, c - a), (a + b + c) * (1.0 / 3.0) - centre) < 0.0) {
+				auto t = b;
+				b = c;
+				c = t;
+			}
+			auto n = normalize(cross(b - a, c - a));
+			triangle(vertex(a, n, 0.0, 0.0), vertex(b, n, 1.0, 0.0), vertex(c, n, 0.5, 1.0));
+		}
+
+		// A flat unit square around centre facing along u x v
+		constexpr void quad(const dvec3& centre, const dvec3& u, const dvec3& v)
+		{
+			auto n = cross(u, v);
+			auto first = vertex(centre - u * 0.5 - v * 0.5, n, 0.0, 0.0);
+			vertex(centre + u * 0.5 - v * 0.5, n, 1.0, 0.0);
+			vertex(centre + u * 0.5 + v * 0.5, n, 1.0, 1.0);
+			vertex(centre - u * 0.5 + v * 0.5, n, 0.0, 1.0);
+			triangle(first, first + 1, first + 2);
+			triangle(first, first + 2, first + 3);
+		}
+
+		// A fan of slices across the circle of radius 0.5 at height y, facing up or down
+		constexpr void disk(double y, bool up, unsigned int slices)
+		{
+			dvec3 n = { 0.0, up ? 1.0 : -1.0, 0.0 };
+			auto centre = vertex({ 0.0, y, 0.0 }, n, 0.5, 0.5);
+			for (unsigned int i = 0; i < slices; ++i) {
+				auto angle = 2.0 * pi * i / slices;
+				auto c = cos(angle), s = sin(angle);
+				vertex({ 0.5 * c, y, 0.5 * s }, n, 0.5 + 0.5 * c, 0.5 + 0.5 * s);
+			}
+			for (unsigned int i = 0; i < slices; ++i) {
+				auto a = centre + 1 + i, b = centre + 1 + (i + 1) % slices;
+				if (up) {
+					triangle(centre, b, a);
+				} else {
+					triangle(centre, a, b);
+				}
+			}
+		}
+
+		constexpr static_mesh<Vertices, Indices> pack() const
+		{
+			if (_vertex_count != Vertices || _index_count != Indices) {
+				throw std::logic_error("Static mesh built with the wrong counts");
+			}
+			static_mesh<Vertices, Indices> mesh = {};
+			dvec3 low = _positions[0], high = _positions[0];
+			for (auto& p : _positions) {
+				low = { p.x < low.x ? p.x : low.x, p.y < low.y ? p.y : low.y, p.z < low.z ? p.z : low.z };
+				high = { p.x > high.x ? p.x : high.x, p.y > high.y ? p.y : high.y, p.z > high.z ? p.z : high.z };
+			}
+			double lows[] = { low.x, low.y, low.z }, extents[] = { high.x - low.x, high.y - low.y, high.z - low.z };
+			for (int c = 0; c < 3; ++c) {
+				mesh.bounds_min[c] = static_cast<float>(lows[c]);
+				mesh.bounds_max[c] = static_cast<float>(lows[c] + extents[c]);
+				// A flat side keeps a scale of 1, as gpu_mesh does
+				extents[c] = extents[c] > 0.0 ? extents[c] : 1.0;
+			}
+			for (size_t i = 0; i < Vertices; ++i) {
+				double p[] = { _positions[i].x, _positions[i].y, _positions[i].z };
+				for (int c = 0; c < 3; ++c) {
+					mesh.positions[i][c] = static_cast<uint16_t>(round((p[c] - lows[c]) / extents[c] * 65535.0));
+				}
+				mesh.attributes[i] = pack_attributes(_normals[i], _tex_coords[i][0], _tex_coords[i][1]);
+			}
+			for (size_t i = 0; i < Indices; ++i) {
+				mesh.indices[i] = _indices[i];
+			}
+			return mesh;
+		}
+	};
+}
+
+// Four vertices a face, so each face keeps its own normal
+constexpr static_mesh<24, 36> make_box()
+{
+	compile_time::builder<24, 36> b;
+	b.quad({ 0.5, 0.0, 0.0 }, { 0.0, 0.0, -1.0 }, { 0.0, 1.0, 0.0 });
+	b.quad({ -0.5, 0.0, 0.0 }, { 0.0, 0.0, 1.0 }, { 0.0, 1.0, 0.0 });
+	b.quad({ 0.0, 0.5, 0.0 }, { 1.0, 0.0, 0.0 }, { 0.0, 0.0, -1.0 });
+	b.quad({ 0.0, -0.5, 0.0 }, { 1.0, 0.0, 0.0 }, { 0.0, 0.0, 1.0 });
+	b.quad({ 0.0, 0.0, 0.5 }, { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 });
+	b.quad({ 0.0, 0.0, -0.5 }, { -1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 });
+	return b.pack();
+}
+
+// Apex above a triangular base, all four faces flat
+constexpr static_mesh<12, 12> make_tetrahedron()
+{
+	compile_time::builder<12, 12> b;
+	compile_time::dvec3 apex = { 0.0, 0.5, 0.0 };
+	compile_time::dvec3 base[] = { { -0.5, -0.5, 0.5 }, { 0.5, -0.5, 0.5 }, { 0.0, -0.5, -0.5 } };
+	auto centre = (apex + base[0] + base[1] + base[2]) * 0.25;
+	for (int i = 0; i < 3; ++i) {
+		b.face(apex, base[i], base[(i + 1) % 3], centre);
+	}
+	b.face(base[0], base[1], base[2], centre);
+	return b.pack();
+}
+
+// Apex above a square base
+constexpr static_mesh<16, 18> make_pyramid()
+{
+	compile_time::builder<16, 18> b;
+	compile_time::dvec3 apex = { 0.0, 0.5, 0.0 };
+	compile_time::dvec3 base[] = { { -0.5, -0.5, 0.5 }, { 0.5, -0.5, 0.5 }, { 0.5, -0.5, -0.5 }, { -0.5, -0.5, -0.5 } };
+	compile_time::dvec3 centre = { 0.0, -0.25, 0.0 };
+	for (int i = 0; i < 4; ++i) {
+		b.face(apex, base[i], base[(i + 1) % 4], centre);
+	}
+	b.quad({ 0.0, -0.5, 0.0 }, { 1.0, 0.0, 0.0 }, { 0.0, 0.0, 1.0 });
+	return b.pack();
+}
+
+// Flat on the x-z plane facing up
+template <unsigned int Slices>
+constexpr static_mesh<Slices + 1, 3 * Slices> make_disk()
+{
+	static_assert(Slices >= 3, "A disk needs at least three slices");
+	compile_time::builder<Slices + 1, 3 * Slices> b;
+	b.disk(0.0, true, Slices);
+	return b.pack();
+}
+
+// Upright, its side a grid of stacks by slices with a seam column so texture
+// coordinates wrap, and capped top and bottom
+template <unsigned int Stacks, unsigned int Slices>
+constexpr static_mesh<(Stacks + 1) * (Slices + 1) + 2 * (Slices + 1), 6 * Stacks * Slices + 6 * Slices> make_cylinder()
+{
+	static_assert(Stacks >= 1 && Slices >= 3, "A cylinder needs a stack and three slices");
+	compile_time::builder<(Stacks + 1) * (Slices + 1) + 2 * (Slices + 1), 6 * Stacks * Slices + 6 * Slices> b;
+	for (unsigned int stack = 0; stack <= Stacks; ++stack) {
+		for (unsigned int slice = 0; slice <= Slices; ++slice) {
+			auto angle = 2.0 * compile_time::pi * slice / Slices;
+			auto c = compile_time::cos(angle), s = compile_time::sin(angle);
+			b.vertex({ 0.5 * c, -0.5 + static_cast<double>(stack) / Stacks, 0.5 * s }, { c, 0.0, s },
+				static_cast<double>(slice) / Slices, static_cast<double>(stack) / Stacks);
+		}
+	}
+	for (unsigned int stack = 0; stack < Stacks; ++stack) {
+		for (unsigned int slice = 0; slice < Slices; ++slice) {
+			auto a = stack * (Slices + 1) + slice, d = a + Slices + 1;
+			b.triangle(a, d + 1, a + 1);
+			b.triangle(a, d, d + 1);
+		}
+	}
+	b.disk(0.5, true, Slices);
+	b.disk(-0.5, false, Slices);
+	return b.pack();
+}
@@ -0,0 +1,223 @@
+#include "terrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+// Terrain texture weight for a height, blending four bands (0, 0.15, 0.5 and 0.9)
+static vec4 terrain_weight(float height)
+{
+	vec4 tex_weight(clamp(1.0f - abs(height - 0.0f) / 0.25f, 0.0f, 1.0f),
+		clamp(1.0f - abs(height - 0.15f) / 0.25f, 0.0f, 1.0f),
+		clamp(1.0f - abs(height - 0.5f) / 0.25f, 0.0f, 1.0f),
+		clamp(1.0f - abs(height - 0.9f) / 0.25f, 0.0f, 1.0f));
+	// Divide weight by the sum of its components
+	auto sum = tex_weight.x + tex_weight.y + tex_weight.z + tex_weight.w;
+	tex_weight /= sum;
+	return tex_weight;
+}
+
+void build_terrain(terrain_data& terrain, const heightmap& height_map, unsigned int width, unsigned int depth,
+	float height_scale, bool with_weights, terrain_normals normals, thread_pool& pool,
+	const function<void(terrain_stage)>& stage_done)
+{
+	auto map_width = height_map.get_width();
+	auto map_height = height_map.get_height();
+	auto finish = [&](terrain_stage stage) {
+		if (stage_done) {
+			stage_done(stage);
+		}
+	};
+
+	// Each stage sizes its buffers up front so the bands can write by index
+	size_t vertex_count = static_cast<size_t>(map_width) * map_height;
+	size_t cell_count = static_cast<size_t>(map_width - 1) * (map_height - 1);
+
+	// Determine ratio of height map to geometry
+	float width_point = static_cast<float>(width) / static_cast<float>(map_width);
+	float depth_point = static_cast<float>(depth) / static_cast<float>(map_height);
+
+	// Part 1 - Positions, texture coordinates and weights, one band of x columns per thread
+	terrain.positions.resize(vertex_count);
+	terrain.tex_coords.resize(vertex_count);
+	terrain.tex_weights.resize(with_weights ? vertex_count : 0);
+	pool.parallel_for(0, map_width, [&](size_t begin, size_t end) {
+		for (auto x = static_cast<unsigned int>(begin); x < end; ++x) {
+			auto column = static_cast<size_t>(x) * map_height;
+
+			// Calculate x position of point
+			vec3 point;
+			point.x = -(width / 2.0f) + (width_point * static_cast<float>(x));
+
+			for (unsigned int z = 0; z < map_height; ++z) {
+				// Calculate z position of point
+				point.z = -(depth / 2.0f) + (depth_point * static_cast<float>(z));
+				// Y position based on the height map data
+				auto height = height_map.get(x, z);
+				point.y = height * height_scale;
+				terrain.positions[column + z] = point;
+				terrain.tex_coords[column + z] = vec2(width_point * x, depth_point * z);
+				if (with_weights) {
+					terrain.tex_weights[column + z] = terrain_weight(height);
+				}
+			}
+		}
+	}, 16);
+	finish(terrain_stage::vertices);
+
+	// Part 1 - Indices for the cells to the right of each column
+	terrain.indices.resize(cell_count * 6);
+	pool.parallel_for(0, map_width - 1, [&](size_t begin, size_t end) {
+		for (auto x = static_cast<unsigned int>(begin); x < end; ++x) {
+			auto index = &terrain.indices[static_cast<size_t>(x) * (map_height - 1) * 6];
+			for (unsigned int y = 0; y < map_height - 1; ++y) {
+				// Get four corners of patch
+				unsigned int top_left = (y * map_width) + x;
+				unsigned int top_right = (y * map_width) + x + 1;
+				unsigned int bottom_left = ((y + 1) * map_width) + x;
+				// Uses the map height to match the original generator on non-square maps
+				unsigned int bottom_right = ((y + 1) * map_height) + x + 1;
+				// Triangle 1 (tl,br,bl)
+				*index++ = top_left;
+				*index++ = bottom_right;
+				*index++ = bottom_left;
+				// Triangle 2 (tl,tr,br)
+				*index++ = top_left;
+				*index++ = top_right;
+				*index++ = bottom_right;
+			}
+		}
+	}, 16);
+	finish(terrain_stage::indices);
+
+	terrain.normals.assign(vertex_count, vec3(0.0f));
+
+	// Part 2 - Gather normals straight from the height map, one column per call
+	// as the buffers are ordered x-major
+	if (normals == terrain_normals::gather) {
+		pool.parallel_for(0, map_height, [&](size_t begin, size_t end) {
+			for (auto z = begin; z < end; ++z) {
+				heightfield_normal_row(height_map, static_cast<unsigned int>(z), 0, map_width, width_point, depth_point,
+					height_scale, &terrain.normals[z], map_height);
+			}
+		}, 16);
+		finish(terrain_stage::normals);
+		return;
+	}
+
+	// Part 2 - Calculate normals for the height map.  Scattering into shared vertices
+	// is order dependent, so this stays serial to keep the output identical.
+	auto& positions = terrain.positions;
+	auto& indices = terrain.indices;
+	auto& normal_data = terrain.normals;
+	for (size_t i = 0; i < indices.size() / 3; ++i) {
+		// Get indices for the triangle
+		auto idx1 = indices[i * 3];
+		auto idx2 = indices[i * 3 + 1];
+		auto idx3 = indices[i * 3 + 2];
+
+		// Calculate two sides of the triangle
+		vec3 side1 = positions[idx1] - positions[idx3];
+		vec3 side2 = positions[idx1] - positions[idx2];
+
+		// Add to normals in the normal buffer using the indices for the triangle
+		vec3 n = normalize(side2 * side1);
+		normal_data[idx1] += n;
+		normal_data[idx2] += n;
+		normal_data[idx3] += n;
+	}
+
+	// Normalize all the normals
+	pool.parallel_for(0, normal_data.size(), [&](size_t begin, size_t end) {
+		for (auto i = begin; i < end; ++i) {
+			normal_data[i] = normalize(normal_data[i]);
+		}
+	}, 4096);
+	finish(terrain_stage::normals);
+}
+
+void heightfield_normal_row(const heightmap& height_map, unsigned int z, unsigned int x_begin, unsigned int x_end,
+	float cell_width, float cell_depth, float height_scale, vec3* out, size_t stride)
+{
+	auto map_width = height_map.get_width();
+	auto map_height = height_map.get_height();
+
+	// Rows either side, clamped to the map
+	auto z0 = z > 0 ? z - 1 : z;
+	auto z1 = std::min(z + 1, map_height - 1);
+	auto row = height_map.data() + static_cast<size_t>(z) * map_width;
+	auto row_down = height_map.data() + static_cast<size_t>(z0) * map_width;
+	auto row_up = height_map.data() + static_cast<size_t>(z1) * map_width;
+
+	// Slope per sample step, folding in the 16-bit to 0-1 scale
+	auto unit = height_scale / 65535.0f;
+	auto scale_x = unit / (2.0f * cell_width);
+	auto scale_z = unit / (static_cast<float>(z1 - z0) * cell_depth);
+
+	// Normal of (-dh/dx, 1, -dh/dz) for a single sample
+	auto scalar = [&](unsigned int x) {
+		auto x0 = x > 0 ? x - 1 : x;
+		auto x1 = std::min(x + 1, map_width - 1);
+		auto dx = (static_cast<float>(row[x1]) - static_cast<float>(row[x0])) * (unit / (static_cast<float>(x1 - x0) * cell_width));
+		auto dz = (static_cast<float>(row_up[x]) - static_cast<float>(row_down[x])) * scale_z;
+		auto inv = 1.0f / sqrt(dx * dx + 1.0f + dz * dz);
+		out[(x - x_begin) * stride] = vec3(-dx * inv, inv, -dz * inv);
+	};
+
+	auto x = x_begin;
+
+	// The first column only has a neighbour on one side
+	while (x < x_end && x == 0) {
+		scalar(x++);
+	}
+
+#ifdef TERRAIN_SSE2
+	// Four interior samples at a time
+	auto zero = _mm_setzero_si128();
+	auto one = _mm_set1_ps(1.0f);
+	auto sx = _mm_set1_ps(scale_x);
+	auto sz = _mm_set1_ps(scale_z);
+	auto load = [&](const uint16_t* p) {
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero));
+	};
+	for (; x + 4 <= x_end && x + 4 < map_width; x += 4) {
+		auto dx = _mm_mul_ps(_mm_sub_ps(load(row + x + 1), load(row + x - 1)), sx);
+		auto dz = _mm_mul_ps(_mm_sub_ps(load(row_up + x), load(row_down + x)), sz);
+		auto len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), one), _mm_mul_ps(dz, dz)));
+		auto inv = _mm_div_ps(one, len);
+		alignas(16) float nx[4], ny[4], nz[4];
+		_mm_store_ps(nx, _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(dx, inv)));
+		_mm_store_ps(ny, inv);
+		_mm_store_ps(nz, _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(dz, inv)));
+		for (int i = 0; i < 4; ++i) {
+			out[(x + i - x_begin) * stride] = vec3(nx[i], ny[i], nz[i]);
+		}
+	}
+#endif
+
+	// Whatever is left, including the last column
+	while (x < x_end) {
+		scalar(x++);
+	}
+}
+
+void compute_heightfield_normals(const heightmap& height_map, float cell_width, float cell_depth, float height_scale,
+	vector<vec3>& normals, thread_pool& pool)
+{
+	auto map_width = height_map.get_width();
+	normals.resize(static_cast<size_t>(map_width) * height_map.get_height());
+	pool.parallel_for(0, height_map.get_height(), [&](size_t begin, size_t end) {
+		for (auto z = begin; z < end; ++z) {
+			heightfield_normal_row(height_map, static_cast<unsigned int>(z), 0, map_width, cell_width, cell_depth,
+				height_scale, &normals[z * map_width]);
+		}
+	}, 16);
+}
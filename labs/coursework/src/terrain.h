@@ -0,0 +1,63 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "heightmap.h"
+#include "thread_pool.h"
+
+// CPU side terrain buffers, laid out exactly as the geometry buffers expect them
+struct terrain_data
+{
+	// Position of each height map sample, ordered x-major (index = x * map height + z)
+	std::vector<glm::vec3> positions;
+	// Normal of each vertex
+	std::vector<glm::vec3> normals;
+	// Texture coordinate of each vertex
+	std::vector<glm::vec2> tex_coords;
+	// Four layer texture weights of each vertex (only filled when requested)
+	std::vector<glm::vec4> tex_weights;
+	// Two triangles per height map cell
+	std::vector<unsigned int> indices;
+};
+
+// How build_terrain produces its normals
+enum class terrain_normals
+{
+	// Accumulate a normal per triangle into its vertices, as the original generator did
+	scatter,
+	// Gather each vertex normal from its neighbours' heights (see heightfield_normal_row)
+	gather
+};
+
+// Stages of build_terrain, in the order they finish
+enum class terrain_stage
+{
+	// Positions, texture coordinates and weights
+	vertices,
+	indices,
+	normals
+};
+
+// Builds terrain buffers from a height map. Every buffer is sized up front and the
+// positions, texture coordinates, weights and indices are filled in parallel column
+// bands. With scatter normals the output is identical to the old serial push_back
+// version; gather normals are computed in parallel and are true surface normals.
+// stage_done, when given, is called on the calling thread as each stage ends.
+void build_terrain(terrain_data& terrain, const heightmap& height_map, unsigned int width, unsigned int depth,
+	float height_scale, bool with_weights = false, terrain_normals normals = terrain_normals::scatter,
+	thread_pool& pool = thread_pool::shared(), const std::function<void(terrain_stage)>& stage_done = nullptr);
+
+// Computes the normals of height map samples [x_begin, x_end) on row z from the
+// slope between each sample's neighbours (central differences, one-sided at the
+// map edges).  Each normal reads only heights, so rows can run on any thread.
+// cell_width/cell_depth are the spacing between samples in terrain units.
+// out[i * stride] receives the normal of sample x_begin + i.  Uses SSE2 when the
+// compiler targets it.
+void heightfield_normal_row(const heightmap& height_map, unsigned int z, unsigned int x_begin, unsigned int x_end,
+	float cell_width, float cell_depth, float height_scale, glm::vec3* out, size_t stride = 1);
+
+// Normals for the whole height map, row-major (normals[z * width + x]), one band of rows per thread
+void compute_heightfield_normals(const heightmap& height_map, float cell_width, float cell_depth, float height_scale,
+	std::vector<glm::vec3>& normals, thread_pool& pool = thread_pool::shared());
@@ -0,0 +1,591 @@
+#include "terrain_lod.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "frustum.h"
+#include "terrain.h"
+#include "vertex_cache.h"
+#include "vertex_packing.h"
+
+using namespace std;
+using namespace graphics_framework;
+using namespace glm;
+
+namespace
+{
+	// Throws unless every level's step divides a chunk, so no level indexes past
+	// the chunk's grid and skirt into the next slot
+	void check_levels(unsigned int chunk_cells, unsigned int levels)
+	{
+		if (levels == 0 || levels > 31 || chunk_cells % (1u << (levels - 1)) != 0) {
+			throw runtime_error("Terrain chunks of " + to_string(chunk_cells) + " cells cannot hold " +
+				to_string(levels) + " levels of detail");
+		}
+	}
+}
+
+terrain_lod::~terrain_lod()
+{
+	// Jobs still on the pool write into this terrain
+	finish_requests();
+}
+
+void terrain_lod::finish_requests()
+{
+	for (auto& request : _requests) {
+		request.wait();
+	}
+	_requests.clear();
+	lock_guard<mutex> lock(_finished_mutex);
+	_finished.clear();
+}
+
+void terrain_lod::release_buffers()
+{
+	if (_vao) {
+		glDeleteVertexArrays(1, &_vao);
+	}
+	GLuint buffers[] = { _vertex_buffer, _index_buffer, _chunk_buffer };
+	for (auto buffer : buffers) {
+		if (buffer) {
+			glDeleteBuffers(1, &buffer);
+		}
+	}
+	_vao = _vertex_buffer = _index_buffer = _chunk_buffer = 0;
+}
+
+void terrain_lod::setup(unsigned int map_width, unsigned int map_height, unsigned int width, unsigned int depth,
+	float height_scale, unsigned int chunk_cells)
+{
+	// A rebuild replaces every buffer
+	finish_requests();
+	release_buffers();
+
+	_map_width = map_width;
+	_map_height = map_height;
+	_width = static_cast<float>(width);
+	_depth = static_cast<float>(depth);
+	_height_scale = height_scale;
+
+	_chunk_cells = chunk_cells;
+	// Grid vertices, then one row of skirt vertices along each of the four sides
+	_chunk_vertices = (chunk_cells + 1) * (chunk_cells + 1) + 4 * (chunk_cells + 1);
+	_chunks_x = (map_width - 2) / chunk_cells + 1;
+	_chunks_z = (map_height - 2) / chunk_cells + 1;
+
+	// Same spacing as build_terrain
+	_width_point = _width / static_cast<float>(map_width);
+	_depth_point = _depth / static_cast<float>(map_height);
+	_lod_distance = 4.0f * chunk_cells * std::max(_width_point, _depth_point);
+
+	_chunks.resize(static_cast<size_t>(_chunks_x) * _chunks_z);
+	for (size_t c = 0; c < _chunks.size(); ++c) {
+		auto& ch = _chunks[c];
+		ch.x = static_cast<unsigned int>(c % _chunks_x);
+		ch.z = static_cast<unsigned int>(c / _chunks_x);
+		ch.slot = -1;
+		ch.last_used = 0;
+		ch.last_wanted = 0;
+		ch.requested = false;
+		ch.prefetch = false;
+	}
+	_frame = 0;
+}
+
+void terrain_lod::fill_chunk(unsigned int cx, unsigned int cz, const heightmap& source, unsigned int sx,
+	unsigned int sz, vertex* out, vector<vec3>& row_normals, vec3& box_min, vec3& box_max) const
+{
+	auto n = _chunk_cells;
+	auto x0 = cx * n;
+	auto z0 = cz * n;
+	// Samples of the chunk inside the map; partial chunks at the far sides just
+	// collapse their overhanging cells onto the edge
+	auto x_count = std::min(x0 + n + 1, _map_width) - x0;
+	auto z_count = std::min(z0 + n + 1, _map_height) - z0;
+
+	box_min = vec3(numeric_limits<float>::max());
+	box_max = vec3(-numeric_limits<float>::max());
+	for (unsigned int z = 0; z <= n; ++z) {
+		auto lz = std::min(z, z_count - 1);
+		heightfield_normal_row(source, sz + lz, sx, sx + x_count, _width_point, _depth_point, _height_scale,
+			row_normals.data());
+		for (unsigned int x = 0; x <= n; ++x) {
+			auto lx = std::min(x, x_count - 1);
+			auto& v = out[z * (n + 1) + x];
+			v.height = source.data()[static_cast<size_t>(sz + lz) * source.get_width() + sx + lx];
+			v.reserved = 0;
+			auto normal = encode_octahedral(row_normals[lx]);
+			v.normal[0] = normal[0];
+			v.normal[1] = normal[1];
+			// Same position terrain.vert rebuilds, for the bounds
+			auto position = vec3(-(_width / 2.0f) + _width_point * (x0 + lx), v.height / 65535.0f * _height_scale,
+				-(_depth / 2.0f) + _depth_point * (z0 + lz));
+			box_min = min(box_min, position);
+			box_max = max(box_max, position);
+		}
+	}
+
+	// Skirts hang below the lowest point of the chunk, covering any gap to a
+	// neighbour drawn at a different level.  They copy the edge vertices; the
+	// shader replaces their height with the chunk's skirt height.
+	auto skirt = out + (n + 1) * (n + 1);
+	for (unsigned int t = 0; t <= n; ++t) {
+		skirt[t] = out[t];
+		skirt[(n + 1) + t] = out[n * (n + 1) + t];
+		skirt[2 * (n + 1) + t] = out[t * (n + 1)];
+		skirt[3 * (n + 1) + t] = out[t * (n + 1) + n];
+	}
+	box_min.y -= std::max(box_max.y - box_min.y, _width_point);
+}
+
+void terrain_lod::build(const heightmap& height_map, unsigned int width, unsigned int depth, float height_scale,
+	unsigned int chunk_cells, unsigned int levels, thread_pool& pool)
+{
+	check_levels(chunk_cells, levels);
+	setup(height_map.get_width(), height_map.get_height(), width, depth, height_scale, chunk_cells);
+	_source = nullptr;
+	_pool = &pool;
+
+	// Every chunk is resident, each in the slot matching its index
+	vector<vertex> vertices(_chunks.size() * _chunk_vertices);
+	_slot_chunks.resize(_chunks.size());
+	pool.parallel_for(0, _chunks.size(), [&](size_t begin, size_t end) {
+		vector<vec3> row_normals(chunk_cells + 1);
+		for (auto c = begin; c < end; ++c) {
+			auto& ch = _chunks[c];
+			fill_chunk(ch.x, ch.z, height_map, ch.x * chunk_cells, ch.z * chunk_cells, &vertices[c * _chunk_vertices],
+				row_normals, ch.box_min, ch.box_max);
+			ch.slot = static_cast<int>(c);
+			_slot_chunks[c] = static_cast<int>(c);
+		}
+	}, 4);
+
+	// Quadtree over the chunk grid
+	_nodes.clear();
+	_nodes.reserve(_chunks.size() * 2);
+	build_node(0, 0, _chunks_x, _chunks_z);
+
+	create_buffers(static_cast<unsigned int>(_chunks.size()), vertices.data(), levels);
+}
+
+void terrain_lod::build(const tiled_heightfield& source, unsigned int width, unsigned int depth, float height_scale,
+	size_t budget_bytes, unsigned int levels, thread_pool& pool)
+{
+	check_levels(source.get_tile_cells(), levels);
+	setup(source.get_width(), source.get_height(), width, depth, height_scale, source.get_tile_cells());
+	_source = &source;
+	_pool = &pool;
+
+	// Bounds come from the tile range table, so nothing is paged in until a tile
+	// is wanted.  They match what fill_chunk will produce for the tile.
+	for (auto& ch : _chunks) {
+		uint16_t lowest, highest;
+		source.get_tile_range(ch.x, ch.z, lowest, highest);
+		auto x1 = std::min((ch.x + 1) * _chunk_cells, _map_width - 1);
+		auto z1 = std::min((ch.z + 1) * _chunk_cells, _map_height - 1);
+		ch.box_min = vec3(-(_width / 2.0f) + _width_point * ch.x * _chunk_cells, lowest / 65535.0f * height_scale,
+			-(_depth / 2.0f) + _depth_point * ch.z * _chunk_cells);
+		ch.box_max = vec3(-(_width / 2.0f) + _width_point * x1, highest / 65535.0f * height_scale,
+			-(_depth / 2.0f) + _depth_point * z1);
+		ch.box_min.y -= std::max(ch.box_max.y - ch.box_min.y, _width_point);
+	}
+
+	_nodes.clear();
+	_nodes.reserve(_chunks.size() * 2);
+	build_node(0, 0, _chunks_x, _chunks_z);
+
+	// As many slots as fit the budget, but never more than there are chunks
+	auto slots = budget_bytes / (static_cast<size_t>(_chunk_vertices) * sizeof(vertex));
+	slots = std::max<size_t>(std::min(slots, _chunks.size()), 1);
+	_slot_chunks.assign(slots, -1);
+
+	// Keep a square of chunks around the eye loaded, small enough that half the
+	// slots are left for whatever else is in view
+	_prefetch_radius = 0;
+	while ((2 * (_prefetch_radius + 1) + 1) * (2 * (_prefetch_radius + 1) + 1) <= slots / 2) {
+		++_prefetch_radius;
+	}
+	_max_requests = std::max(pool.size(), 1u);
+	_max_uploads = 4;
+
+	create_buffers(static_cast<unsigned int>(slots), nullptr, levels);
+}
+
+void terrain_lod::create_buffers(unsigned int slots, const vertex* vertices, unsigned int levels)
+{
+	// Every level of detail goes into one index buffer, shared by all chunks.  Chunk
+	// vertices are addressed from each slot's base vertex, so 16-bit indices do
+	// whenever a chunk has no more than 65536 vertices.
+	vector<uint32_t> indices;
+	vector<size_t> firsts;
+	for (unsigned int level = 0; level < levels; ++level) {
+		firsts.push_back(indices.size());
+		build_lod_indices(1u << level, indices);
+	}
+	firsts.push_back(indices.size());
+	auto short_indices = _chunk_vertices <= 65536;
+	_index_type = short_indices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	auto index_size = short_indices ? sizeof(GLushort) : sizeof(GLuint);
+	_lods.clear();
+	for (unsigned int level = 0; level < levels; ++level) {
+		lod_range range;
+		range.count = static_cast<GLsizei>(firsts[level + 1] - firsts[level]);
+		range.offset = firsts[level] * index_size;
+		range.cache = simulate_vertex_cache(indices.data() + firsts[level], range.count);
+		_lods.push_back(range);
+	}
+	vector<GLushort> packed;
+	if (short_indices) {
+		packed.assign(indices.begin(), indices.end());
+	}
+
+	// Chunk table for the vertex shader; entries of streamed slots are written as their chunks arrive
+	chunk_table table;
+	table.cell_size = vec2(_width_point, _depth_point);
+	table.origin = vec2(-(_width / 2.0f), -(_depth / 2.0f));
+	table.last_sample[0] = _map_width - 1;
+	table.last_sample[1] = _map_height - 1;
+	table.chunk_cells = _chunk_cells;
+	table.height_scale = _height_scale;
+	vector<vec4> entries(slots, vec4(0.0f));
+	for (unsigned int slot = 0; slot < slots; ++slot) {
+		if (_slot_chunks[slot] >= 0) {
+			entries[slot] = chunk_entry(_chunks[_slot_chunks[slot]]);
+		}
+	}
+	glGenBuffers(1, &_chunk_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _chunk_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(chunk_table) + entries.size() * sizeof(vec4), nullptr,
+		vertices ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(chunk_table), &table);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(chunk_table), entries.size() * sizeof(vec4), entries.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Upload to the GPU; streamed slots are filled as their chunks arrive
+	glGenVertexArrays(1, &_vao);
+	glBindVertexArray(_vao);
+	glGenBuffers(1, &_vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<size_t>(slots) * _chunk_vertices * sizeof(vertex), vertices,
+		vertices ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+	// Both attributes are normalised integers: height to 0-1, normal to -1-1
+	glEnableVertexAttribArray(BUFFER_INDEXES::POSITION_BUFFER);
+	glVertexAttribPointer(BUFFER_INDEXES::POSITION_BUFFER, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(vertex),
+		(void*)offsetof(vertex, height));
+	glEnableVertexAttribArray(BUFFER_INDEXES::NORMAL_BUFFER);
+	glVertexAttribPointer(BUFFER_INDEXES::NORMAL_BUFFER, 2, GL_SHORT, GL_TRUE, sizeof(vertex),
+		(void*)offsetof(vertex, normal));
+	glGenBuffers(1, &_index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * index_size,
+		short_indices ? static_cast<const void*>(packed.data()) : indices.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+}
+
+void terrain_lod::build_lod_indices(unsigned int step, vector<uint32_t>& indices) const
+{
+	auto n = _chunk_cells;
+	auto grid = [n](unsigned int x, unsigned int z) { return z * (n + 1) + x; };
+	auto skirt = [n](unsigned int side, unsigned int t) { return (n + 1) * (n + 1) + side * (n + 1) + t; };
+
+	// Two triangles per cell in vertex cache sized strips
+	grid_indices(n, step, grid_order::strips, indices);
+
+	// A strip of skirt along each side, joining edge vertices to the copies hanging
+	// below.  Each side is finished before the next so its edge is still cached.
+	for (unsigned int t = 0; t < n; t += step) {
+		// z = 0
+		indices.insert(indices.end(), {
+			grid(t, 0), grid(t + step, 0), skirt(0, t + step), grid(t, 0), skirt(0, t + step), skirt(0, t)
+		});
+	}
+	for (unsigned int t = 0; t < n; t += step) {
+		// z = n
+		indices.insert(indices.end(), {
+			grid(t, n), skirt(1, t), skirt(1, t + step), grid(t, n), skirt(1, t + step), grid(t + step, n)
+		});
+	}
+	for (unsigned int t = 0; t < n; t += step) {
+		// x = 0
+		indices.insert(indices.end(), {
+			grid(0, t), skirt(2, t), skirt(2, t + step), grid(0, t), skirt(2, t + step), grid(0, t + step)
+		});
+	}
+	for (unsigned int t = 0; t < n; t += step) {
+		// x = n
+		indices.insert(indices.end(), {
+			grid(n, t), grid(n, t + step), skirt(3, t + step), grid(n, t), skirt(3, t + step), skirt(3, t)
+		});
+	}
+}
+
+int terrain_lod::build_node(unsigned int x0, unsigned int z0, unsigned int x1, unsigned int z1)
+{
+	auto index = static_cast<int>(_nodes.size());
+	_nodes.push_back(node());
+	node n;
+	n.children[0] = n.children[1] = n.children[2] = n.children[3] = -1;
+	n.chunk = -1;
+
+	if (x1 - x0 == 1 && z1 - z0 == 1) {
+		// Leaf - a single chunk
+		n.chunk = static_cast<int>(z0 * _chunks_x + x0);
+		n.box_min = _chunks[n.chunk].box_min;
+		n.box_max = _chunks[n.chunk].box_max;
+	} else {
+		// Split into up to four children, skipping empty halves of thin rectangles
+		auto xm = (x0 + x1 + 1) / 2;
+		auto zm = (z0 + z1 + 1) / 2;
+		unsigned int xs[3] = { x0, xm, x1 };
+		unsigned int zs[3] = { z0, zm, z1 };
+		n.box_min = vec3(numeric_limits<float>::max());
+		n.box_max = vec3(-numeric_limits<float>::max());
+		for (int i = 0; i < 4; ++i) {
+			auto cx0 = xs[i % 2], cx1 = xs[i % 2 + 1];
+			auto cz0 = zs[i / 2], cz1 = zs[i / 2 + 1];
+			if (cx0 == cx1 || cz0 == cz1) {
+				continue;
+			}
+			auto child = build_node(cx0, cz0, cx1, cz1);
+			n.children[i] = child;
+			n.box_min = min(n.box_min, _nodes[child].box_min);
+			n.box_max = max(n.box_max, _nodes[child].box_max);
+		}
+	}
+
+	_nodes[index] = n;
+	return index;
+}
+
+void terrain_lod::upload_finished()
+{
+	// Take a few finished builds, leaving the rest for later frames so one frame
+	// never stalls on a burst of uploads
+	vector<pair<int, vector<vertex>>> ready;
+	{
+		lock_guard<mutex> lock(_finished_mutex);
+		auto count = std::min(_finished.size(), static_cast<size_t>(_max_uploads));
+		move(_finished.begin(), _finished.begin() + count, back_inserter(ready));
+		_finished.erase(_finished.begin(), _finished.begin() + count);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
+	for (auto& build : ready) {
+		auto& ch = _chunks[build.first];
+		ch.requested = false;
+
+		// A free slot, otherwise the least recently drawn chunk that was not drawn
+		// last frame.  A prefetched chunk leaves the prefetch square alone, or two
+		// builds around the eye would keep evicting each other.
+		int slot = -1;
+		unsigned int oldest = _frame;
+		for (size_t s = 0; s < _slot_chunks.size(); ++s) {
+			if (_slot_chunks[s] < 0) {
+				slot = static_cast<int>(s);
+				break;
+			}
+			auto& held = _chunks[_slot_chunks[s]];
+			auto last_used = held.last_used;
+			if (last_used + 1 < _frame && last_used < oldest && !(ch.prefetch && held.last_wanted + 1 >= _frame)) {
+				oldest = last_used;
+				slot = static_cast<int>(s);
+			}
+		}
+		if (slot < 0) {
+			// Everything resident is in view; the chunk is asked for again once room frees up
+			continue;
+		}
+		if (_slot_chunks[slot] >= 0) {
+			_chunks[_slot_chunks[slot]].slot = -1;
+		}
+		_slot_chunks[slot] = build.first;
+		ch.slot = slot;
+		ch.last_used = _frame;
+		glBufferSubData(GL_ARRAY_BUFFER, static_cast<size_t>(slot) * _chunk_vertices * sizeof(vertex),
+			_chunk_vertices * sizeof(vertex), build.second.data());
+		auto entry = chunk_entry(ch);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, _chunk_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(chunk_table) + slot * sizeof(vec4), sizeof(vec4), &entry);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void terrain_lod::request_chunks(const vec3& eye_pos, vector<int>& wanted)
+{
+	// Forget builds that have finished, surfacing any exception they threw
+	for (size_t i = 0; i < _requests.size();) {
+		if (_requests[i].wait_for(chrono::seconds(0)) == future_status::ready) {
+			_requests[i].get();
+			_requests[i] = move(_requests.back());
+			_requests.pop_back();
+		} else {
+			++i;
+		}
+	}
+
+	// Chunks around the eye, so turning round finds them already loaded.  Those
+	// resident are marked so other prefetches do not evict them.
+	auto chunk_size = _chunk_cells * _width_point;
+	auto chunk_depth = _chunk_cells * _depth_point;
+	auto ex = static_cast<int>(floor((eye_pos.x + _width / 2.0f) / chunk_size));
+	auto ez = static_cast<int>(floor((eye_pos.z + _depth / 2.0f) / chunk_depth));
+	auto r = static_cast<int>(_prefetch_radius);
+	vector<int> nearby;
+	for (auto z = std::max(ez - r, 0); z <= std::min(ez + r, static_cast<int>(_chunks_z) - 1); ++z) {
+		for (auto x = std::max(ex - r, 0); x <= std::min(ex + r, static_cast<int>(_chunks_x) - 1); ++x) {
+			auto c = z * static_cast<int>(_chunks_x) + x;
+			_chunks[c].last_wanted = _frame;
+			if (_chunks[c].slot < 0 && !_chunks[c].requested) {
+				nearby.push_back(c);
+			}
+		}
+	}
+
+	// Slots a visible chunk could go in: free ones, and ones not drawn last
+	// frame.  Spare slots are those a prefetched chunk could also go in.
+	size_t available = 0, spare = 0;
+	for (auto c : _slot_chunks) {
+		if (c < 0) {
+			++available;
+			++spare;
+		} else if (_chunks[c].last_used + 1 < _frame) {
+			++available;
+			spare += _chunks[c].last_wanted + 1 < _frame;
+		}
+	}
+	size_t pending;
+	{
+		lock_guard<mutex> lock(_finished_mutex);
+		pending = _finished.size();
+	}
+	auto in_flight = _requests.size() + pending;
+	if (available <= in_flight || _requests.size() >= _max_requests) {
+		return;
+	}
+	auto budget = std::min(available - in_flight, static_cast<size_t>(_max_requests) - _requests.size());
+	auto prefetch_budget = spare > in_flight ? spare - in_flight : 0;
+
+	// Visible chunks before prefetched ones, each nearest first
+	auto distance = [&](int c) {
+		auto& ch = _chunks[c];
+		return length(eye_pos - clamp(eye_pos, ch.box_min, ch.box_max));
+	};
+	auto nearest = [&](int a, int b) { return distance(a) < distance(b); };
+	sort(wanted.begin(), wanted.end(), nearest);
+	sort(nearby.begin(), nearby.end(), nearest);
+	auto visible = wanted.size();
+	wanted.insert(wanted.end(), nearby.begin(), nearby.end());
+
+	for (size_t i = 0; i < wanted.size() && budget > 0; ++i) {
+		auto c = wanted[i];
+		auto& ch = _chunks[c];
+		if (ch.requested) {
+			continue;
+		}
+		ch.prefetch = i >= visible;
+		if (ch.prefetch && prefetch_budget == 0) {
+			break;
+		}
+		// A visible chunk may take a spare slot too
+		prefetch_budget -= prefetch_budget > 0;
+		ch.requested = true;
+		--budget;
+		auto cx = ch.x, cz = ch.z;
+		_requests.push_back(_pool->submit([this, c, cx, cz]() {
+			// Reading the mapped tile pages it in here, off the render thread
+			auto tile = _source->get_tile(cx, cz);
+			vector<vertex> vertices(_chunk_vertices);
+			vector<vec3> row_normals(_chunk_cells + 1);
+			vec3 box_min, box_max;
+			fill_chunk(cx, cz, tile, 1, 1, vertices.data(), row_normals, box_min, box_max);
+			lock_guard<mutex> lock(_finished_mutex);
+			_finished.emplace_back(c, move(vertices));
+		}));
+	}
+}
+
+void terrain_lod::update(const mat4& MVP, const vec3& eye_pos)
+{
+	_draw_counts.clear();
+	_draw_offsets.clear();
+	_draw_base_vertices.clear();
+	_drawn_triangles = 0;
+	if (_nodes.empty()) {
+		return;
+	}
+
+	++_frame;
+	if (_source) {
+		upload_finished();
+	}
+
+	frustum view(MVP);
+	auto max_level = static_cast<int>(_lods.size()) - 1;
+	vector<int> wanted;
+
+	// Walk the quadtree, dropping whole subtrees outside the frustum
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		auto& n = _nodes[stack[--top]];
+		if (!view.intersects(n.box_min, n.box_max)) {
+			continue;
+		}
+		if (n.chunk < 0) {
+			for (auto child : n.children) {
+				if (child >= 0) {
+					stack[top++] = child;
+				}
+			}
+			continue;
+		}
+
+		// Streamed chunks that have not arrived yet are asked for and skipped
+		auto& ch = _chunks[n.chunk];
+		if (ch.slot < 0) {
+			if (!ch.requested) {
+				wanted.push_back(n.chunk);
+			}
+			continue;
+		}
+		ch.last_used = _frame;
+
+		// Level from the distance between the eye and the nearest point of the chunk
+		auto nearest = clamp(eye_pos, n.box_min, n.box_max);
+		auto d = length(eye_pos - nearest);
+		auto level = 0;
+		if (d > _lod_distance) {
+			level = std::min(static_cast<int>(log2(d / _lod_distance)) + 1, max_level);
+		}
+
+		_draw_counts.push_back(_lods[level].count);
+		_draw_offsets.push_back(reinterpret_cast<const void*>(_lods[level].offset));
+		_draw_base_vertices.push_back(static_cast<GLint>(ch.slot * _chunk_vertices));
+		_drawn_triangles += _lods[level].count / 3;
+	}
+
+	if (_source) {
+		request_chunks(eye_pos, wanted);
+	}
+}
+
+void terrain_lod::render() const
+{
+	if (_draw_counts.empty()) {
+		return;
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _chunk_buffer);
+	glBindVertexArray(_vao);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, _draw_counts.data(), _index_type, _draw_offsets.data(),
+		static_cast<GLsizei>(_draw_counts.size()), _draw_base_vertices.data());
+	glBindVertexArray(0);
+}
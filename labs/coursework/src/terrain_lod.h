@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <graphics_framework.h>
+
+#include "heightmap.h"
+#include "thread_pool.h"
+#include "tiled_heightfield.h"
+#include "vertex_cache.h"
+
+// Terrain split into fixed size chunks held in a quadtree.  Each frame the
+// quadtree is culled against the view frustum and every visible chunk picks a
+// level of detail (geomipmapping) from its distance to the eye.  Cracks between
+// chunks at different levels are hidden by a skirt around each chunk.
+// Chunks live in slots of one shared vertex buffer, and one index buffer holds
+// every level, so the visible set is drawn with a single multi-draw call.
+//
+// Vertices store only what the grid cannot give: a 16-bit height and a packed
+// normal.  res/shaders/terrain.vert rebuilds x, z and the texture coordinate
+// from gl_VertexID and a table of chunk origins, one entry per slot.
+//
+// Built from a tiled_heightfield the terrain streams: only as many slots as fit
+// the memory budget exist, tiles around the eye are built on the thread pool
+// and uploaded as they finish, and the least recently drawn chunk gives up its
+// slot when a new one arrives.
+class terrain_lod
+{
+public:
+	// Packed vertex, 8 bytes against 32 for full position, normal and texture coordinate
+	struct vertex
+	{
+		// Height sample, 0-65535 spanning 0 to height_scale (position attribute)
+		uint16_t height;
+		// Keeps the normal 4-byte aligned
+		uint16_t reserved;
+		// Octahedral normal from encode_octahedral (normal attribute)
+		int16_t normal[2];
+	};
+
+	// Header of the chunk table read by terrain.vert, matching its std430 layout.
+	// One glm::vec4 per slot follows: the chunk's first sample x and z, and the
+	// height its skirt hangs down to.
+	struct chunk_table
+	{
+		// Terrain space distance between samples along x and z
+		glm::vec2 cell_size;
+		// Terrain space position of sample (0, 0)
+		glm::vec2 origin;
+		// Last sample along x and z, which partial chunks clamp to
+		uint32_t last_sample[2];
+		uint32_t chunk_cells;
+		float height_scale;
+	};
+
+private:
+	// A chunk of the terrain grid and its bounds in terrain space
+	struct chunk
+	{
+		unsigned int x, z;
+		glm::vec3 box_min, box_max;
+		// Slot in the vertex buffer, -1 when not resident
+		int slot;
+		// Frame the chunk was last drawn, for least recently used eviction
+		unsigned int last_used;
+		// Frame the chunk last lay in the prefetch square around the eye
+		unsigned int last_wanted;
+		// Whether a build is on the thread pool
+		bool requested;
+		// Whether the build was asked for ahead of the chunk being seen, so it may
+		// only displace chunks that are neither in view nor prefetched themselves
+		bool prefetch;
+	};
+
+	// A quadtree node covering a rectangle of chunks
+	struct node
+	{
+		glm::vec3 box_min, box_max;
+		// Child nodes, -1 where there is none
+		int children[4];
+		// Chunk drawn by a leaf, -1 for inner nodes
+		int chunk;
+	};
+
+	// Where one level of detail lives in the shared index buffer
+	struct lod_range
+	{
+		GLsizei count;
+		// Byte offset into the index buffer
+		size_t offset;
+		// How the level's index order uses the vertex cache
+		vertex_cache_stats cache;
+	};
+
+	// Cells along each side of a chunk
+	unsigned int _chunk_cells = 0;
+	// Vertices stored per chunk, grid plus skirt
+	unsigned int _chunk_vertices = 0;
+	// Chunks along x and z
+	unsigned int _chunks_x = 0;
+	unsigned int _chunks_z = 0;
+	// Distance at which level 1 starts; each further level doubles it
+	float _lod_distance = 0.0f;
+
+	// Terrain space mapping, the same as build_terrain
+	unsigned int _map_width = 0;
+	unsigned int _map_height = 0;
+	float _width = 0.0f;
+	float _depth = 0.0f;
+	float _height_scale = 0.0f;
+	float _width_point = 0.0f;
+	float _depth_point = 0.0f;
+
+	std::vector<chunk> _chunks;
+	std::vector<node> _nodes;
+	std::vector<lod_range> _lods;
+
+	// Streaming source, null when every chunk is resident
+	const tiled_heightfield* _source = nullptr;
+	// Thread pool the tile builds run on
+	thread_pool* _pool = nullptr;
+	// Chunks currently in each slot, -1 for free slots
+	std::vector<int> _slot_chunks;
+	// Chunks either side of the eye's chunk kept loaded ahead of being seen
+	unsigned int _prefetch_radius = 0;
+	// Most builds allowed in flight and uploads allowed per frame
+	unsigned int _max_requests = 0;
+	unsigned int _max_uploads = 0;
+	// Builds on the pool, waited on at destruction
+	std::vector<std::future<void>> _requests;
+	// Finished builds waiting for upload
+	std::vector<std::pair<int, std::vector<vertex>>> _finished;
+	std::mutex _finished_mutex;
+	unsigned int _frame = 0;
+
+	// GL objects, freed when the terrain is built again and otherwise living as
+	// long as the context like the framework's own
+	GLuint _vao = 0;
+	GLuint _vertex_buffer = 0;
+	GLuint _index_buffer = 0;
+	// Shader storage buffer holding the chunk_table
+	GLuint _chunk_buffer = 0;
+	// GL_UNSIGNED_SHORT when a chunk's vertices fit 16-bit indices, else GL_UNSIGNED_INT
+	GLenum _index_type = GL_UNSIGNED_INT;
+
+	// Draw list built by update()
+	std::vector<GLsizei> _draw_counts;
+	std::vector<const void*> _draw_offsets;
+	std::vector<GLint> _draw_base_vertices;
+	size_t _drawn_triangles = 0;
+
+	// Sets up the chunk grid, terrain space mapping and index buffer
+	void setup(unsigned int map_width, unsigned int map_height, unsigned int width, unsigned int depth,
+		float height_scale, unsigned int chunk_cells);
+	// Creates the GL buffers with room for the given number of chunk slots, filled
+	// from vertices when it is not null, and the index buffer for every level
+	void create_buffers(unsigned int slots, const vertex* vertices, unsigned int levels);
+	// Waits for tile builds still running and drops any not yet uploaded
+	void finish_requests();
+	// Deletes the GL objects of the last build, if any
+	void release_buffers();
+	// Fills the vertices of chunk (cx, cz) from source, where source sample (sx, sz)
+	// is the chunk's first grid sample.  Returns the chunk's bounds, skirt included.
+	void fill_chunk(unsigned int cx, unsigned int cz, const heightmap& source, unsigned int sx, unsigned int sz,
+		vertex* out, std::vector<glm::vec3>& row_normals, glm::vec3& box_min, glm::vec3& box_max) const;
+	// Chunk table entry of a chunk: first sample x and z, and skirt height
+	glm::vec4 chunk_entry(const chunk& ch) const
+	{
+		return glm::vec4(ch.x * _chunk_cells, ch.z * _chunk_cells, ch.box_min.y, 0.0f);
+	}
+	// Builds the quadtree node for chunks [x0, x1) x [z0, z1), returning its index
+	int build_node(unsigned int x0, unsigned int z0, unsigned int x1, unsigned int z1);
+	// Builds the index list of one level of detail
+	void build_lod_indices(unsigned int step, std::vector<uint32_t>& indices) const;
+	// Uploads finished tile builds, evicting least recently used chunks for room
+	void upload_finished();
+	// Queues builds for missing chunks in view, then near the eye, nearest first.
+	// wanted holds the visible chunks that are not resident.
+	void request_chunks(const glm::vec3& eye_pos, std::vector<int>& wanted);
+
+public:
+	terrain_lod() = default;
+	// Waits for any tile builds still running.  The GL objects are left to the
+	// context, which may already be gone when a global terrain is destroyed.
+	~terrain_lod();
+
+	terrain_lod(const terrain_lod&) = delete;
+	terrain_lod& operator=(const terrain_lod&) = delete;
+
+	// Builds every chunk from a height map over the same area as build_terrain.
+	// chunk_cells must be divisible by 2^(levels - 1) so every level lands on grid
+	// vertices; std::runtime_error is thrown otherwise.
+	void build(const heightmap& height_map, unsigned int width, unsigned int depth, float height_scale,
+		unsigned int chunk_cells = 64, unsigned int levels = 4, thread_pool& pool = thread_pool::shared());
+
+	// Streams chunks from a tiled height field (one chunk per tile), keeping at most
+	// budget_bytes of vertex data on the GPU.  The source must outlive the terrain,
+	// and its tile_cells is held to the same rule as chunk_cells above.
+	void build(const tiled_heightfield& source, unsigned int width, unsigned int depth, float height_scale,
+		size_t budget_bytes, unsigned int levels = 4, thread_pool& pool = thread_pool::shared());
+
+	// Uploads streamed chunks, culls the quadtree and selects levels of detail.
+	// MVP and eye_pos are for the terrain's own model space.
+	void update(const glm::mat4& MVP, const glm::vec3& eye_pos);
+
+	// Draws the chunks selected by the last update, with an effect built from terrain.vert bound
+	void render() const;
+
+	// Distance at which level 1 starts
+	float get_lod_distance() const { return _lod_distance; }
+	void set_lod_distance(float distance) { _lod_distance = distance; }
+	// Number of chunks in the terrain
+	size_t get_chunk_count() const { return _chunks.size(); }
+	// Number of chunks that can be resident at once
+	size_t get_slot_count() const { return _slot_chunks.size(); }
+	// Chunks drawn by the last update
+	size_t get_drawn_chunks() const { return _draw_counts.size(); }
+	// Triangles drawn by the last update, skirts included
+	size_t get_drawn_triangles() const { return _drawn_triangles; }
+	// Simulated vertex cache use of a level's indices, skirts included
+	const vertex_cache_stats& get_lod_cache_stats(unsigned int level) const { return _lods.at(level).cache; }
+};
@@ -0,0 +1,93 @@
+#include "thread_pool.h"
+
+#include <exception>
+
+using namespace std;
+
+thread_pool::thread_pool(unsigned int threads)
+{
+	// hardware_concurrency is allowed to report zero
+	threads = max(threads, 1u);
+	_workers.reserve(threads);
+	for (unsigned int i = 0; i < threads; ++i) {
+		_workers.emplace_back([this]() { worker_loop(); });
+	}
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		lock_guard<mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_wake.notify_all();
+	for (auto& w : _workers) {
+		w.join();
+	}
+}
+
+void thread_pool::worker_loop()
+{
+	for (;;) {
+		function<void()> job;
+		{
+			unique_lock<mutex> lock(_mutex);
+			_wake.wait(lock, [this]() { return _stopping || !_jobs.empty(); });
+			// Only leave once the queue has drained
+			if (_jobs.empty()) {
+				return;
+			}
+			job = move(_jobs.front());
+			_jobs.pop();
+		}
+		job();
+	}
+}
+
+void thread_pool::parallel_for(size_t begin, size_t end, const function<void(size_t, size_t)>& body, size_t min_band)
+{
+	if (end <= begin) {
+		return;
+	}
+
+	// One band per worker plus the calling thread, unless that makes bands too small
+	auto count = end - begin;
+	auto bands = min<size_t>(size() + 1, max<size_t>(count / max<size_t>(min_band, 1), 1));
+	auto band_size = (count + bands - 1) / bands;
+
+	// Queue every band but the first
+	vector<future<void>> pending;
+	pending.reserve(bands);
+	for (auto b = begin + band_size; b < end; b += band_size) {
+		auto e = min(b + band_size, end);
+		pending.push_back(submit([&body, b, e]() { body(b, e); }));
+	}
+
+	// Work on the first band here while the workers take the rest
+	exception_ptr error;
+	try {
+		body(begin, min(begin + band_size, end));
+	} catch (...) {
+		error = current_exception();
+	}
+
+	// Every band must finish before body goes out of scope, even on failure
+	for (auto& p : pending) {
+		try {
+			p.get();
+		} catch (...) {
+			if (!error) {
+				error = current_exception();
+			}
+		}
+	}
+	if (error) {
+		rethrow_exception(error);
+	}
+}
+
+thread_pool& thread_pool::shared()
+{
+	static thread_pool pool;
+	return pool;
+}
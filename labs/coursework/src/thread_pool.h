@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that pull jobs from a shared queue
+class thread_pool
+{
+private:
+	// The worker threads
+	std::vector<std::thread> _workers;
+	// Jobs waiting for a worker
+	std::queue<std::function<void()>> _jobs;
+	// Guards the job queue and the stop flag
+	std::mutex _mutex;
+	// Signalled when a job is queued or the pool is stopping
+	std::condition_variable _wake;
+	// Set when the pool is being destroyed
+	bool _stopping = false;
+
+	// Loop run by each worker thread
+	void worker_loop();
+
+public:
+	// Creates the pool with the given number of workers (at least one)
+	explicit thread_pool(unsigned int threads = std::thread::hardware_concurrency());
+	// Finishes any queued jobs then joins the workers
+	~thread_pool();
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	// Number of worker threads
+	unsigned int size() const { return static_cast<unsigned int>(_workers.size()); }
+
+	// Queues a job and returns a future for its result
+	template <typename F>
+	auto submit(F&& job) -> std::future<decltype(job())>
+	{
+		using result_type = decltype(job());
+		auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(job));
+		auto result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_jobs.emplace([task]() { (*task)(); });
+		}
+		_wake.notify_one();
+		return result;
+	}
+
+	// Splits [begin, end) into contiguous bands of at least min_band items and
+	// calls body(band_begin, band_end) for each band, blocking until all are done.
+	// The calling thread works on the first band itself, so this must not be
+	// called from inside a job already running on this pool.
+	void parallel_for(size_t begin, size_t end, const std::function<void(size_t, size_t)>& body, size_t min_band = 1);
+
+	// Pool shared by the whole application, sized to the hardware
+	static thread_pool& shared();
+};
@@ -0,0 +1,147 @@
+#include "tiled_heightfield.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+tiled_heightfield::tiled_heightfield(const string& filename) : _file(filename)
+{
+	if (_file.size() < sizeof(header)) {
+		throw runtime_error("Tiled height field " + filename + " is too small");
+	}
+	_header = reinterpret_cast<const header*>(_file.data());
+	if (memcmp(_header->magic, "THF1", 4) != 0 || _header->version != current_version) {
+		throw runtime_error("Tiled height field " + filename + " has an unknown format");
+	}
+
+	// Check the file really holds every tile before handing out pointers into it
+	size_t tile_count = static_cast<size_t>(_header->tiles_x) * _header->tiles_z;
+	size_t tile_size = static_cast<size_t>(get_tile_samples()) * get_tile_samples();
+	size_t expected = sizeof(header) + (tile_count * 2 + tile_count * tile_size) * sizeof(uint16_t);
+	if (_file.size() < expected) {
+		throw runtime_error("Tiled height field " + filename + " is truncated");
+	}
+	_ranges = reinterpret_cast<const uint16_t*>(_file.data() + sizeof(header));
+	_tiles = _ranges + tile_count * 2;
+}
+
+tiled_heightfield tiled_heightfield::open(const string& source, const string& filename, unsigned int tile_cells)
+{
+	uint64_t source_hash, source_size;
+	{
+		mapped_file file(source);
+		source_hash = hash_bytes(file.data(), file.size());
+		source_size = file.size();
+	}
+
+	// Use the tiles when they were cut from this exact file
+	try {
+		tiled_heightfield tiles(filename);
+		if (tiles._header->source_hash == source_hash && tiles._header->source_size == source_size &&
+			tiles._header->tile_cells == tile_cells) {
+			return tiles;
+		}
+	} catch (const runtime_error&) {
+		// Missing or stale, so cut them again below
+	}
+
+	write(heightmap(source), filename, tile_cells, source_hash, source_size);
+	return tiled_heightfield(filename);
+}
+
+void tiled_heightfield::write(const heightmap& source, const string& filename, unsigned int tile_cells,
+	uint64_t source_hash, uint64_t source_size)
+{
+	header h;
+	memcpy(h.magic, "THF1", 4);
+	h.version = current_version;
+	h.width = source.get_width();
+	h.height = source.get_height();
+	h.tile_cells = tile_cells;
+	h.tiles_x = (h.width - 2) / tile_cells + 1;
+	h.tiles_z = (h.height - 2) / tile_cells + 1;
+	h.reserved = 0;
+	h.source_hash = source_hash;
+	h.source_size = source_size;
+
+	ofstream file(filename, ios::binary);
+	if (!file) {
+		throw runtime_error("Could not create tiled height field " + filename);
+	}
+	file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+	// Range table goes before the tiles, so reserve it and fill it in at the end
+	size_t tile_count = static_cast<size_t>(h.tiles_x) * h.tiles_z;
+	vector<uint16_t> ranges(tile_count * 2);
+	file.write(reinterpret_cast<const char*>(ranges.data()), ranges.size() * sizeof(uint16_t));
+
+	// Samples just past the map edge continue the edge slope, so the central
+	// differences taken across a tile's apron give the same normals as the
+	// one-sided differences build_terrain uses at the map edge
+	function<int(int, int)> sample = [&](int x, int z) -> int {
+		int w = static_cast<int>(h.width), d = static_cast<int>(h.height);
+		x = min(max(x, -1), w);
+		z = min(max(z, -1), d);
+		if (z < 0 || z == d) {
+			auto edge = z < 0 ? 0 : d - 1, inner = z < 0 ? 1 : d - 2;
+			return min(max(2 * sample(x, edge) - sample(x, inner), 0), 0xffff);
+		}
+		if (x < 0 || x == w) {
+			auto edge = x < 0 ? 0 : w - 1, inner = x < 0 ? 1 : w - 2;
+			return min(max(2 * sample(edge, z) - sample(inner, z), 0), 0xffff);
+		}
+		return source.data()[static_cast<size_t>(z) * h.width + x];
+	};
+
+	// Only one tile is held in memory at a time
+	auto samples = tile_cells + 3;
+	vector<uint16_t> tile(static_cast<size_t>(samples) * samples);
+	for (unsigned int tz = 0; tz < h.tiles_z; ++tz) {
+		for (unsigned int tx = 0; tx < h.tiles_x; ++tx) {
+			uint16_t lowest = 0xffff, highest = 0;
+			for (unsigned int z = 0; z < samples; ++z) {
+				// Apron starts one sample before the tile
+				auto sz = static_cast<int>(tz * tile_cells + z) - 1;
+				for (unsigned int x = 0; x < samples; ++x) {
+					auto sx = static_cast<int>(tx * tile_cells + x) - 1;
+					auto v = static_cast<uint16_t>(sample(sx, sz));
+					tile[z * samples + x] = v;
+					// The range covers the tile's samples inside the map, not its apron
+					if (x >= 1 && z >= 1 && x <= tile_cells + 1 && z <= tile_cells + 1
+						&& sx < static_cast<int>(h.width) && sz < static_cast<int>(h.height)) {
+						lowest = min(lowest, v);
+						highest = max(highest, v);
+					}
+				}
+			}
+			ranges[(static_cast<size_t>(tz) * h.tiles_x + tx) * 2] = lowest;
+			ranges[(static_cast<size_t>(tz) * h.tiles_x + tx) * 2 + 1] = highest;
+			file.write(reinterpret_cast<const char*>(tile.data()), tile.size() * sizeof(uint16_t));
+		}
+	}
+
+	file.seekp(sizeof(h));
+	file.write(reinterpret_cast<const char*>(ranges.data()), ranges.size() * sizeof(uint16_t));
+	if (!file) {
+		throw runtime_error("Could not write tiled height field " + filename);
+	}
+}
+
+heightmap tiled_heightfield::get_tile(unsigned int tx, unsigned int tz) const
+{
+	size_t tile_size = static_cast<size_t>(get_tile_samples()) * get_tile_samples();
+	auto tile = _tiles + (static_cast<size_t>(tz) * _header->tiles_x + tx) * tile_size;
+	return heightmap::view(get_tile_samples(), get_tile_samples(), tile);
+}
+
+void tiled_heightfield::get_tile_range(unsigned int tx, unsigned int tz, uint16_t& lowest, uint16_t& highest) const
+{
+	auto range = _ranges + (static_cast<size_t>(tz) * _header->tiles_x + tx) * 2;
+	lowest = range[0];
+	highest = range[1];
+}
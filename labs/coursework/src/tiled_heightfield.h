@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "heightmap.h"
+#include "mapped_file.h"
+
+// A height field stored as fixed size square tiles in one file, so a world far
+// bigger than memory can be memory-mapped and read a tile at a time.
+//
+// Layout (little endian): a header, a table of each tile's lowest and highest
+// sample (so bounds are known without touching tile data), then every tile in
+// row-major order.  A tile holds (tile_cells + 3)^2 samples: its own
+// (tile_cells + 1)^2 plus a one sample apron on every side, so normals at tile
+// edges match their neighbours.  Samples past the map edge continue its slope.
+class tiled_heightfield
+{
+public:
+	struct header
+	{
+		char magic[4];
+		uint32_t version;
+		// Whole map size in samples
+		uint32_t width;
+		uint32_t height;
+		// Cells along each side of a tile
+		uint32_t tile_cells;
+		uint32_t tiles_x;
+		uint32_t tiles_z;
+		uint32_t reserved;
+		// Content hash (hash_bytes) and size of the file the tiles were cut from,
+		// 0 when written from a height map in memory
+		uint64_t source_hash;
+		uint64_t source_size;
+	};
+
+	static const uint32_t current_version = 2;
+
+private:
+	mapped_file _file;
+	const header* _header = nullptr;
+	// Lowest and highest sample of each tile
+	const uint16_t* _ranges = nullptr;
+	// First tile
+	const uint16_t* _tiles = nullptr;
+
+public:
+	tiled_heightfield() = default;
+	// Maps a tiled file, throwing std::runtime_error if it is missing or malformed
+	explicit tiled_heightfield(const std::string& filename);
+
+	// Maps the tiled copy of the height map file source, first writing it from
+	// source when it is missing, was cut from a different file or has another
+	// tile size
+	static tiled_heightfield open(const std::string& source, const std::string& filename, unsigned int tile_cells);
+
+	// Splits a height map into tiles and writes them to a file, one tile at a
+	// time, recording the hash and size of the file the map came from
+	static void write(const heightmap& source, const std::string& filename, unsigned int tile_cells,
+		uint64_t source_hash = 0, uint64_t source_size = 0);
+
+	// Whole map size in samples
+	unsigned int get_width() const { return _header->width; }
+	unsigned int get_height() const { return _header->height; }
+	// Cells along each side of a tile
+	unsigned int get_tile_cells() const { return _header->tile_cells; }
+	unsigned int get_tiles_x() const { return _header->tiles_x; }
+	unsigned int get_tiles_z() const { return _header->tiles_z; }
+	// Samples along each side of a stored tile, apron included
+	unsigned int get_tile_samples() const { return _header->tile_cells + 3; }
+
+	// View of a tile's samples, apron included.  Sample (1, 1) is map sample
+	// (tx * tile_cells, tz * tile_cells).  Reading it pages the tile in.
+	heightmap get_tile(unsigned int tx, unsigned int tz) const;
+	// Map sample (x, z), read from the tile holding it
+	uint16_t get_sample(unsigned int x, unsigned int z) const
+	{
+		auto cells = _header->tile_cells;
+		auto tx = x / cells < _header->tiles_x ? x / cells : _header->tiles_x - 1;
+		auto tz = z / cells < _header->tiles_z ? z / cells : _header->tiles_z - 1;
+		size_t samples = cells + 3;
+		auto tile = _tiles + (static_cast<size_t>(tz) * _header->tiles_x + tx) * samples * samples;
+		// Past the apron's first row and column
+		return tile[(z - tz * cells + 1) * samples + (x - tx * cells + 1)];
+	}
+	// Lowest and highest samples of a tile, from the table
+	void get_tile_range(unsigned int tx, unsigned int tz, uint16_t& lowest, uint16_t& highest) const;
+};
@@ -0,0 +1,210 @@
+#include "vertex_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void grid_indices(unsigned int cells, unsigned int step, grid_order order, vector<uint32_t>& out,
+	unsigned int cache_size)
+{
+	auto grid = [cells](unsigned int x, unsigned int z) { return z * (cells + 1) + x; };
+	auto cell = [&](unsigned int x, unsigned int z) {
+		out.insert(out.end(), {
+			grid(x, z), grid(x, z + step), grid(x + step, z + step),
+			grid(x, z), grid(x + step, z + step), grid(x + step, z)
+		});
+	};
+	out.reserve(out.size() + static_cast<size_t>(cells / step) * (cells / step) * 6);
+
+	if (order == grid_order::rows) {
+		for (unsigned int z = 0; z < cells; z += step) {
+			for (unsigned int x = 0; x < cells; x += step) {
+				cell(x, z);
+			}
+		}
+		return;
+	}
+
+	// A strip w cells wide touches w + 1 vertices per row and a row only reuses
+	// the one before it, so two rows have to fit in the cache with room for the
+	// FIFO to have pushed a little further by the time a vertex comes back round
+	auto strip_cells = std::max(cache_size / 2, 3u) - 2;
+	auto strip_width = strip_cells * step;
+	for (unsigned int x0 = 0; x0 < cells; x0 += strip_width) {
+		auto x1 = std::min(x0 + strip_width, cells);
+		for (unsigned int z = 0; z < cells; z += step) {
+			for (unsigned int x = x0; x < x1; x += step) {
+				cell(x, z);
+			}
+		}
+	}
+}
+
+vertex_cache_stats simulate_vertex_cache(const uint32_t* indices, size_t count, unsigned int cache_size)
+{
+	vertex_cache_stats stats;
+	stats.triangles = count / 3;
+	if (count == 0) {
+		return stats;
+	}
+
+	// Miss count when each vertex last entered the cache; it is still cached until
+	// cache_size more misses have pushed it out
+	auto highest = *max_element(indices, indices + count);
+	vector<size_t> entered(static_cast<size_t>(highest) + 1, 0);
+	vector<bool> seen(entered.size(), false);
+	for (size_t i = 0; i < count; ++i) {
+		auto v = indices[i];
+		if (!seen[v]) {
+			seen[v] = true;
+			++stats.vertices;
+		} else if (stats.transformed - entered[v] <= cache_size) {
+			continue;
+		}
+		entered[v] = stats.transformed++;
+	}
+	return stats;
+}
+
+namespace
+{
+	// Cache modelled by the optimiser, least recently used first out.  Larger than
+	// the FIFO the result is judged on, which only makes the ordering more local.
+	const unsigned int forsyth_cache_size = 32;
+
+	// Score of a vertex from its place in the cache (-1 when not cached) and
+	// the number of triangles still to be emitted that use it
+	float forsyth_score(int cache_position, unsigned int remaining)
+	{
+		if (remaining == 0) {
+			return -1.0f;
+		}
+		auto score = 0.0f;
+		if (cache_position >= 0) {
+			// The last triangle's vertices score a fixed amount so it is not
+			// simply repeated in strips
+			if (cache_position < 3) {
+				score = 0.75f;
+			} else {
+				auto scale = 1.0f - static_cast<float>(cache_position - 3) / (forsyth_cache_size - 3);
+				score = pow(scale, 1.5f);
+			}
+		}
+		// Favour vertices with few triangles left, so they leave the cache finished
+		return score + 2.0f / sqrt(static_cast<float>(remaining));
+	}
+}
+
+void optimise_vertex_cache(uint32_t* indices, size_t count, size_t vertex_count)
+{
+	auto triangles = count / 3;
+	if (triangles < 2) {
+		return;
+	}
+
+	// Triangles around each vertex, packed with an offset per vertex
+	vector<uint32_t> remaining(vertex_count, 0);
+	for (size_t i = 0; i < triangles * 3; ++i) {
+		++remaining[indices[i]];
+	}
+	vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+	vector<uint32_t> adjacency(offsets[vertex_count]);
+	vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0; t < triangles; ++t) {
+		for (int k = 0; k < 3; ++k) {
+			adjacency[filled[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	vector<float> vertex_scores(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		vertex_scores[v] = forsyth_score(-1, remaining[v]);
+	}
+	vector<float> triangle_scores(triangles);
+	for (size_t t = 0; t < triangles; ++t) {
+		triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] +
+			vertex_scores[indices[t * 3 + 2]];
+	}
+	vector<bool> emitted(triangles, false);
+	vector<uint32_t> output;
+	output.reserve(triangles * 3);
+
+	// Cache with room for the three vertices being added past its end
+	uint32_t cache[forsyth_cache_size + 3];
+	unsigned int cache_count = 0;
+	vector<int> cache_position(vertex_count, -1);
+	size_t next_unemitted = 0;
+	auto best = static_cast<size_t>(0);
+	// The first triangle is simply the best scoring one
+	for (size_t t = 1; t < triangles; ++t) {
+		if (triangle_scores[t] > triangle_scores[best]) {
+			best = t;
+		}
+	}
+
+	for (size_t emitted_count = 0; emitted_count < triangles; ++emitted_count) {
+		emitted[best] = true;
+		auto tri = indices + best * 3;
+		output.insert(output.end(), { tri[0], tri[1], tri[2] });
+
+		// The triangle's vertices move to the front of the cache, pushing the rest back
+		uint32_t updated[forsyth_cache_size + 3];
+		unsigned int updated_count = 0;
+		for (int k = 0; k < 3; ++k) {
+			updated[updated_count++] = tri[k];
+		}
+		for (unsigned int i = 0; i < cache_count; ++i) {
+			auto v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				updated[updated_count++] = v;
+			}
+		}
+
+		// Take the triangle off its vertices' lists
+		for (int k = 0; k < 3; ++k) {
+			auto v = tri[k];
+			auto begin = adjacency.begin() + offsets[v];
+			auto end = begin + remaining[v];
+			auto found = find(begin, end, static_cast<uint32_t>(best));
+			*found = *(end - 1);
+			--remaining[v];
+		}
+
+		// Rescore the vertices still cached, and those just pushed out
+		for (unsigned int i = 0; i < updated_count; ++i) {
+			auto v = updated[i];
+			cache_position[v] = i < forsyth_cache_size ? static_cast<int>(i) : -1;
+			vertex_scores[v] = forsyth_score(cache_position[v], remaining[v]);
+		}
+		cache_count = std::min(updated_count, forsyth_cache_size);
+		copy(updated, updated + cache_count, cache);
+
+		// The next triangle is the best scoring one touching the cache...
+		auto best_score = -1.0f;
+		for (unsigned int i = 0; i < updated_count; ++i) {
+			auto v = updated[i];
+			for (auto a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+				auto t = adjacency[a];
+				auto score = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] +
+					vertex_scores[indices[t * 3 + 2]];
+				triangle_scores[t] = score;
+				if (score > best_score) {
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+		// ...or, when nothing left touches it, the next one in the original order
+		if (best_score < 0.0f) {
+			while (next_unemitted < triangles && emitted[next_unemitted]) {
+				++next_unemitted;
+			}
+			best = next_unemitted;
+		}
+	}
+	copy(output.begin(), output.end(), indices);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How grid_indices walks the cells of a grid
+enum class grid_order
+{
+	// One full row after another, the order the generators have always used
+	rows,
+	// Columns of cells narrow enough that the vertices shared with the previous
+	// row are still in the post-transform cache when they are reused
+	strips
+};
+
+// Appends two triangles for every step-th cell of a cells x cells grid whose
+// (cells + 1)^2 vertices are row-major (index = z * (cells + 1) + x), wound
+// anticlockwise seen from above like terrain_lod.  cache_size is the vertex
+// cache the strips are sized for; 16 is safe on older GPUs and still near the
+// best order on larger caches.
+void grid_indices(unsigned int cells, unsigned int step, grid_order order, std::vector<uint32_t>& out,
+	unsigned int cache_size = 16);
+
+// Post-transform cache behaviour of an index list
+struct vertex_cache_stats
+{
+	size_t triangles = 0;
+	// Vertices the shader would run for (cache misses)
+	size_t transformed = 0;
+	// Distinct vertices referenced
+	size_t vertices = 0;
+
+	// Average cache miss ratio - transformed vertices per triangle, 0.5 at best on a grid
+	double acmr() const { return triangles ? static_cast<double>(transformed) / triangles : 0.0; }
+	// Average transform to vertex ratio - 1.0 when every vertex runs exactly once
+	double atvr() const { return vertices ? static_cast<double>(transformed) / vertices : 0.0; }
+};
+
+// Runs a triangle list through a FIFO cache of cache_size vertices, the model
+// most hardware is closest to
+vertex_cache_stats simulate_vertex_cache(const uint32_t* indices, size_t count, unsigned int cache_size = 16);
+
+// Reorders the triangles of an index list so each vertex is reused while it is
+// still in the post-transform cache, using Forsyth's linear speed optimiser:
+// triangles are scored by how recently their vertices were used and how few
+// triangles those vertices have left, and the best is emitted next.
+// vertex_count must be past every index.
+void optimise_vertex_cache(uint32_t* indices, size_t count, size_t vertex_count);
@@ -0,0 +1,97 @@
+#include "vertex_packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace glm;
+
+uint16_t to_half(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (exponent >= 31) {
+		// Too large, infinite or not a number
+		return static_cast<uint16_t>(sign | 0x7c00 | (((bits >> 23) & 0xff) == 0xff && mantissa ? 0x200 : 0));
+	}
+	if (exponent <= 0) {
+		// Subnormal or zero in half precision
+		if (exponent < -10) {
+			return static_cast<uint16_t>(sign);
+		}
+		mantissa |= 0x800000;
+		auto shift = static_cast<uint32_t>(14 - exponent);
+		auto half = mantissa >> shift;
+		// Round to nearest, ties to even
+		auto rest = mantissa & ((1u << shift) - 1);
+		auto midpoint = 1u << (shift - 1);
+		if (rest > midpoint || (rest == midpoint && (half & 1))) {
+			++half;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+	auto half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	// Round to nearest, ties to even; a carry into the exponent is still right
+	auto rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		++half;
+	}
+	return static_cast<uint16_t>(half);
+}
+
+array<int16_t, 2> encode_octahedral(const vec3& normal)
+{
+	auto sum = abs(normal.x) + abs(normal.y) + abs(normal.z);
+	if (sum <= 0.0f) {
+		return { { 0, 0 } };
+	}
+	// Project onto the octahedron |x| + |y| + |z| = 1, folding the lower half over the upper
+	auto x = normal.x / sum, y = normal.y / sum;
+	if (normal.z < 0.0f) {
+		auto folded_x = (1.0f - abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		auto folded_y = (1.0f - abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = folded_x;
+		y = folded_y;
+	}
+	auto snorm = [](float v) { return static_cast<int16_t>(std::round(clamp(v, -1.0f, 1.0f) * 32767.0f)); };
+	return { { snorm(x), snorm(y) } };
+}
+
+vec3 decode_octahedral(const array<int16_t, 2>& encoded)
+{
+	auto x = std::max(encoded[0] / 32767.0f, -1.0f), y = std::max(encoded[1] / 32767.0f, -1.0f);
+	vec3 n(x, y, 1.0f - abs(x) - abs(y));
+	auto t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+vec3 packed_extent(const vec3& low, const vec3& high)
+{
+	auto extent = high - low;
+	for (int c = 0; c < 3; ++c) {
+		extent[c] = extent[c] > 0.0f ? extent[c] : 1.0f;
+	}
+	return extent;
+}
+
+void pack_vertices(size_t count, const vec3* positions, const vec3* normals, const vec2* tex_coords, const vec3& low,
+	const vec3& high, uint16_t* packed_positions, packed_attributes* attributes)
+{
+	auto extent = packed_extent(low, high);
+	for (size_t i = 0; i < count; ++i) {
+		auto unit = clamp((positions[i] - low) / extent, vec3(0.0f), vec3(1.0f));
+		auto packed = packed_positions + i * 4;
+		for (int c = 0; c < 3; ++c) {
+			packed[c] = static_cast<uint16_t>(std::round(unit[c] * 65535.0f));
+		}
+		packed[3] = 0;
+		auto normal = encode_octahedral(normals[i]);
+		attributes[i] = { { normal[0], normal[1] }, { to_half(tex_coords[i].x), to_half(tex_coords[i].y) } };
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Conversions between full precision vertex attributes and the compact forms
+// the GPU reads them in.  Every packed normal in the coursework, a gpu_mesh's
+// or the terrain's, uses the one octahedral convention below, which
+// res/shaders/part_octahedral.vert undoes.
+
+// Nearest half precision float to value, as its bits
+uint16_t to_half(float value);
+
+// A unit vector as two 16-bit signed normalised coordinates of the octahedron
+// it projects onto, the half below z = 0 folded over the one above, and back;
+// the round trip is within 0.05 degrees
+std::array<int16_t, 2> encode_octahedral(const glm::vec3& normal);
+glm::vec3 decode_octahedral(const std::array<int16_t, 2>& encoded);
+
+// Normal and texture coordinate of a packed vertex, as the split layout
+// interleaves them: two 16-bit octahedral coordinates and two half floats
+struct packed_attributes
+{
+	int16_t normal[2];
+	uint16_t tex_coord[2];
+};
+
+// Size of the box from low to high that packed positions are fractions of; a
+// flat side keeps a size of 1 so nothing divides by zero
+glm::vec3 packed_extent(const glm::vec3& low, const glm::vec3& high);
+
+// Packs count vertices into gpu_mesh's packed format: positions as four 16-bit
+// values a vertex, fractions of the box from low to high padded to 8 bytes, and
+// normals and texture coordinates interleaved as packed_attributes
+void pack_vertices(size_t count, const glm::vec3* positions, const glm::vec3* normals, const glm::vec2* tex_coords,
+	const glm::vec3& low, const glm::vec3& high, uint16_t* packed_positions, packed_attributes* attributes);
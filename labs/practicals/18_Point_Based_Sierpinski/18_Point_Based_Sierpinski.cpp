@@ -1,55 +1,126 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <thread>
 
 using namespace std;
 using namespace graphics_framework;
 using namespace glm;
 
-geometry geom;
 effect eff;
 target_camera cam;
 
-const int num_points = 50000;
+const GLsizei num_points = 50000;
+// Points each walker makes at least.  The walker count comes from the point
+// count alone, not the thread count, so the points for a seed are the same on
+// any machine, and each walker's warm-up is a few percent of its run.
+const unsigned int points_per_walker = 1024;
+// Steps each walker takes before its first point; every step halves the
+// distance to the gasket, so by then a walker is on it to float precision
+const unsigned int warm_up_steps = 32;
 
-void create_sierpinski(geometry &geom) {
-  vector<vec3> points;
-  vector<vec4> colours;
-  // Three corners of the triangle
-  array<vec3, 3> v = {
-      vec3(-1.0f, -1.0f, 0.0f),
-      vec3(0.0f, 1.0f, 0.0f),
-      vec3(1.0f, -1.0f, 0.0f)
-  };
-  // Create random engine - generates random numbers
-  default_random_engine e;
-  // Create a distribution.  3 points in array so want 0-2
-  uniform_int_distribution<int> dist(0, 2);
-  // Add first point to the geometry
-  points.push_back(vec3(0.25f, 0.5f, 0.0f));
-  // Add first colour to the geometry
-  colours.push_back(vec4(1.0f, 0.0f, 0.0f, 1.0f));
-  // Add random points using distribution
-  for (auto i = 1; i < num_points; ++i) {
-    // *********************************
-    // Add random point
-    auto random_num = dist(e);
-    points.push_back((points[i - 1] + v[random_num]) / 2.0f);
-    // Add colour - all points red
-    colours.push_back(colours[0]);
-    // *********************************
+// Point vertex array and its position buffer, persistently mapped for writing
+GLuint vao;
+GLuint position_buffer;
+vec2 *mapped_points;
+// Seed of the points in the buffer, and a fence on the last frame drawn from them
+uint64_t seed = 0;
+GLsync drawn = nullptr;
+bool space_down = false;
+
+// Runs body(begin, end) over contiguous bands of [0, count), one band per hardware thread
+void parallel_bands(unsigned int count, const function<void(unsigned int, unsigned int)> &body) {
+  auto threads = std::max(thread::hardware_concurrency(), 1u);
+  auto band = (count + threads - 1) / threads;
+  vector<thread> workers;
+  for (unsigned int begin = band; begin < count; begin += band) {
+    workers.emplace_back(body, begin, std::min(begin + band, count));
+  }
+  // Calling thread takes the first band
+  body(0, std::min(band, count));
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+// Random stream of one walker.  The state starts from splitmix64 of the seed
+// and the walker's index, so every walker's stream is distinct and reproducible,
+// and steps as xorshift64*, which is small enough to keep in a register.
+class walker_random {
+private:
+  uint64_t state;
+
+public:
+  walker_random(uint64_t seed, uint64_t stream) {
+    auto z = seed + (stream + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    state = z ^ (z >> 31);
+    // xorshift never leaves a zero state
+    if (state == 0) {
+      state = 1;
+    }
   }
-  // *********************************
-  // Add buffers to geometry
-  geom.add_buffer(points, BUFFER_INDEXES::POSITION_BUFFER);
-  geom.add_buffer(colours, BUFFER_INDEXES::COLOUR_BUFFER);
-  // *********************************
+
+  // Corner 0-2, from the top 32 bits scaled to 3 rather than a modulo
+  unsigned int next_corner() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    auto bits = (state * 0x2545f4914f6cdd1dull) >> 32;
+    return static_cast<unsigned int>((bits * 3) >> 32);
+  }
+};
+
+// Plays the chaos game for count points into points.  Each walker starts at the
+// same point with its own random stream and writes its own contiguous run of
+// points, so the walkers run on all cores and the result depends only on seed.
+void create_sierpinski(uint64_t seed, vec2 *points, GLsizei count) {
+  // Three corners of the triangle
+  const array<vec2, 3> v = {vec2(-1.0f, -1.0f), vec2(0.0f, 1.0f), vec2(1.0f, -1.0f)};
+  auto walkers = std::max(static_cast<unsigned int>(count) / points_per_walker, 1u);
+  auto per_walker = (static_cast<size_t>(count) + walkers - 1) / walkers;
+  parallel_bands(walkers, [&](unsigned int begin, unsigned int end) {
+    for (auto w = begin; w < end; ++w) {
+      auto first = std::min(w * per_walker, static_cast<size_t>(count));
+      auto last = std::min(first + per_walker, static_cast<size_t>(count));
+      walker_random random(seed, w);
+      auto p = vec2(0.25f, 0.5f);
+      for (unsigned int i = 0; i < warm_up_steps; ++i) {
+        p = (p + v[random.next_corner()]) / 2.0f;
+      }
+      for (auto i = first; i < last; ++i) {
+        p = (p + v[random.next_corner()]) / 2.0f;
+        points[i] = p;
+      }
+    }
+  });
 }
 
 bool load_content() {
-  // Set to points type
-  geom.set_type(GL_POINTS);
+  // Immutable storage mapped once for the life of the app; the walkers write
+  // straight into it, so the points are never copied through another buffer
+  auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  auto size = static_cast<GLsizeiptr>(num_points) * sizeof(vec2);
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &position_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
+  glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+  mapped_points = static_cast<vec2 *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+  if (!mapped_points) {
+    throw runtime_error("Could not map the point buffer");
+  }
+  // Positions are x and y only; the shader's z comes out as 0
+  glVertexAttribPointer(BUFFER_INDEXES::POSITION_BUFFER, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  glEnableVertexAttribArray(BUFFER_INDEXES::POSITION_BUFFER);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
   // Create sierpinski gasket
-  create_sierpinski(geom);
+  create_sierpinski(seed, mapped_points, num_points);
 
   // Load in shaders
   eff.add_shader("shaders/basic.vert", GL_VERTEX_SHADER);
@@ -66,6 +137,16 @@ bool load_content() {
 }
 
 bool update(float delta_time) {
+  // Space plays the game again with the next seed, once the GPU has finished
+  // drawing the points it is about to overwrite
+  auto space = glfwGetKey(renderer::get_window(), GLFW_KEY_SPACE) != 0;
+  if (space && !space_down) {
+    if (drawn) {
+      glClientWaitSync(drawn, GL_SYNC_FLUSH_COMMANDS_BIT, numeric_limits<GLuint64>::max());
+    }
+    create_sierpinski(++seed, mapped_points, num_points);
+  }
+  space_down = space;
   // Update the camera
   cam.update(delta_time);
   return true;
@@ -81,8 +162,15 @@ bool render() {
   auto MVP = P * V * M;
   // Set MVP matrix uniform
   glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
-  // Render geometry
-  renderer::render(geom);
+  // Every point red, from a constant attribute rather than a colour buffer
+  glBindVertexArray(vao);
+  glVertexAttrib4f(BUFFER_INDEXES::COLOUR_BUFFER, 1.0f, 0.0f, 0.0f, 1.0f);
+  glDrawArrays(GL_POINTS, 0, num_points);
+  glBindVertexArray(0);
+  if (drawn) {
+    glDeleteSync(drawn);
+  }
+  drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
   return true;
 }
 
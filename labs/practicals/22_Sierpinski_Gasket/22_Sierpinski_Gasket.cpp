@@ -1,61 +1,118 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include <array>
+#include <functional>
+#include <limits>
+#include <thread>
 
 using namespace std;
 using namespace graphics_framework;
 using namespace glm;
 
-geometry geom;
 effect eff;
 target_camera cam;
 
-// Helper method - adds a triangle to geometry
-void triangle(const vector<vec3> &points, vector<vec3> &positions, vector<vec4> &colours) {
-  positions.insert(positions.end(), points.begin(), points.end());
-  for (auto i = 0; i < 3; ++i){
-    colours.push_back(vec4(1.0f, 0.0f, 0.0f, 1.0f));
+// Levels of division; the gasket has 3^depth triangles
+const unsigned int depth = 4;
+// Triangles generated and uploaded at a time, so deep gaskets never sit whole in memory
+const size_t chunk_triangles = size_t(1) << 20;
+
+// Gasket vertex array and its buffers, filled a chunk at a time
+GLuint vao;
+GLuint buffers[2];
+GLsizei vertex_count;
+
+// Runs body(begin, end) over contiguous bands of [0, count), one band per hardware thread
+void parallel_bands(unsigned int count, const function<void(unsigned int, unsigned int)> &body) {
+  auto threads = std::max(thread::hardware_concurrency(), 1u);
+  auto band = (count + threads - 1) / threads;
+  vector<thread> workers;
+  for (unsigned int begin = band; begin < count; begin += band) {
+    workers.emplace_back(body, begin, std::min(begin + band, count));
+  }
+  // Calling thread takes the first band
+  body(0, std::min(band, count));
+  for (auto &w : workers) {
+    w.join();
   }
 }
 
-void divide_triangle(const vector<vec3> &points, unsigned int count, vector<vec3> &positions, vector<vec4> &colours) {
-  // *********************************
-  // IF we have more divisions to do?
-  if (count > 0) {
-
-    // Calculate new vertices to work on
-    auto A = points[0];
-    auto B = points[1];
-    auto C = points[2];
-
-    // Calculate mid points
-    auto AB = (A + B) / 2.0f;
-    auto BC = (B + C) / 2.0f;
-    auto CA = (C + A) / 2.0f;
-
-    // Divide the new triangles
-    divide_triangle({ A,AB,CA }, count - 1, positions, colours);
-    divide_triangle({ AB,B,BC }, count - 1, positions, colours);
-    divide_triangle({ CA,BC,C }, count - 1, positions, colours);
-
-  } else {
-    triangle(points, positions, colours);
+// Triangles in a gasket of the given depth
+size_t gasket_triangles(unsigned int depth) {
+  size_t count = 1;
+  for (unsigned int level = 0; level < depth; ++level) {
+    count *= 3;
+  }
+  return count;
+}
 
-    for (auto i = 0; i < 3; ++i) {
-        colours.push_back(vec4(0.6f, i % 2, i % 3, 1.0f));
+// Writes triangles [first, first + count) of the gasket, three positions and colours each, to the start of
+// positions and colours.  Triangle t is found from its base 3 digits, most significant first: each digit
+// keeps one corner of the triangle and halves the way to it from the other two, as dividing does, so any
+// range of triangles is independent of the rest and comes out in the order recursion gives.
+void generate_gasket(const array<vec3, 3> &corners, unsigned int depth, size_t first, size_t count, vec3 *positions,
+                     vec4 *colours) {
+  auto top = gasket_triangles(depth) / 3;
+  parallel_bands(static_cast<unsigned int>(count), [&](unsigned int begin, unsigned int end) {
+    for (auto i = begin; i < end; ++i) {
+      auto t = first + i;
+      auto tri = corners;
+      for (auto place = top; place > 0; place /= 3) {
+        auto keep = tri[t / place % 3];
+        for (auto &p : tri) {
+          p = (p + keep) / 2.0f;
+        }
+      }
+      for (auto k = 0; k < 3; ++k) {
+        positions[size_t(i) * 3 + k] = tri[k];
+        colours[size_t(i) * 3 + k] = vec4(0.6f, k % 2, k % 3, 1.0f);
+      }
     }
-  }
-  // *********************************
+  });
 }
 
 bool load_content() {
-  // Required buffers
-  vector<vec3> positions;
-  vector<vec4> colours;
-  divide_triangle({vec3(1.0f, -1.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f), vec3(-1.0f, -1.0f, 0.0f)}, 4, positions, colours);
-
-  // Add to the geometry
-  geom.add_buffer(positions, BUFFER_INDEXES::POSITION_BUFFER);
-  geom.add_buffer(colours, BUFFER_INDEXES::COLOUR_BUFFER);
+  array<vec3, 3> corners = {vec3(1.0f, -1.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f), vec3(-1.0f, -1.0f, 0.0f)};
+  auto triangles = gasket_triangles(depth);
+  if (triangles * 3 > size_t(numeric_limits<GLsizei>::max())) {
+    throw runtime_error("Gasket too deep to draw in one call");
+  }
+  // The colour buffer is the larger of the two
+  if (triangles * 3 > size_t(numeric_limits<GLsizeiptr>::max()) / sizeof(vec4)) {
+    throw runtime_error("Gasket too deep to fit in a buffer");
+  }
+  vertex_count = static_cast<GLsizei>(triangles * 3);
+
+  // Buffers sized for the whole gasket up front, then filled a chunk at a time
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(2, buffers);
+  GLuint indexes[] = {BUFFER_INDEXES::POSITION_BUFFER, BUFFER_INDEXES::COLOUR_BUFFER};
+  GLint sizes[] = {3, 4};
+  for (auto b = 0; b < 2; ++b) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[b]);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertex_count) * sizes[b] * sizeof(float), nullptr,
+                 GL_STATIC_DRAW);
+    // The driver refuses sizes it cannot hold rather than failing later
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+      throw runtime_error("Gasket too deep for the GPU's memory");
+    }
+    glVertexAttribPointer(indexes[b], sizes[b], GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(indexes[b]);
+  }
+  glBindVertexArray(0);
+
+  vector<vec3> positions(std::min(triangles, chunk_triangles) * 3);
+  vector<vec4> colours(positions.size());
+  for (size_t first = 0; first < triangles; first += chunk_triangles) {
+    auto count = std::min(chunk_triangles, triangles - first);
+    generate_gasket(corners, depth, first, count, positions.data(), colours.data());
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferSubData(GL_ARRAY_BUFFER, first * 3 * sizeof(vec3), count * 3 * sizeof(vec3), positions.data());
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+    glBufferSubData(GL_ARRAY_BUFFER, first * 3 * sizeof(vec4), count * 3 * sizeof(vec4), colours.data());
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 
   // Load in shaders
   eff.add_shader("shaders/basic.vert", GL_VERTEX_SHADER);
@@ -87,8 +144,10 @@ bool render() {
   auto MVP = P * V * M;
   // Set MVP matrix uniform
   glUniformMatrix4fv(eff.get_uniform_location("MVP"), 1, GL_FALSE, value_ptr(MVP));
-  // Render geometry
-  renderer::render(geom);
+  // Render the gasket
+  glBindVertexArray(vao);
+  glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+  glBindVertexArray(0);
   return true;
 }
 
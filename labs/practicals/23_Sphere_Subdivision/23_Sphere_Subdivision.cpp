@@ -1,5 +1,8 @@
 #include <glm\glm.hpp>
 #include <graphics_framework.h>
+#include <functional>
+#include <thread>
+#include <unordered_map>
 
 using namespace std;
 using namespace graphics_framework;
@@ -13,42 +16,144 @@ float rho = 0.0f;
 
 const int subdivisions = 5;
 
-// Helper method - adds a triangle to geometry
-void triangle(const vector<vec3>& points, vector<vec3>& positions, vector<vec4>& colours) {
-   positions.insert(positions.end(), points.begin(), points.end());
-   for (auto i = 0; i < 3; ++i) {
-       colours.push_back(vec4(1.0f, 0.0f, 0.0f, 1.0f));
-   }
+// Runs body(begin, end) over contiguous bands of [0, count), one band per hardware thread
+void parallel_bands(unsigned int count, const function<void(unsigned int, unsigned int)> &body) {
+  auto threads = std::max(thread::hardware_concurrency(), 1u);
+  auto band = (count + threads - 1) / threads;
+  vector<thread> workers;
+  for (unsigned int begin = band; begin < count; begin += band) {
+    workers.emplace_back(body, begin, std::min(begin + band, count));
+  }
+  // Calling thread takes the first band
+  body(0, std::min(band, count));
+  for (auto &w : workers) {
+    w.join();
+  }
 }
 
-void divide_triangle(const vector<vec3> &points, int divisions, vector<vec3> &positions, vector<vec4> &colours) {
-  // IF we have more divisions to do?
-  if (divisions > 0) {
-    // *********************************
-    // Calculate new vertices to work on (Normalize each element!)
-    vec3 v0 = normalize(points[0] + points[1]);
-    vec3 v1 = normalize(points[0] + points[2]);
-    vec3 v2 = normalize(points[1] + points[2]);
-    // Divide new triangles
-    divide_triangle({ points[0], v0, v1 }, divisions - 1, positions, colours);
-    divide_triangle({ points[2], v1, v2 }, divisions - 1, positions, colours);
-    divide_triangle({ points[1], v2, v0 }, divisions - 1, positions, colours);
-    divide_triangle({ v0, v2, v1 }, divisions - 1, positions, colours);
-
-    // *********************************
-  } else {
-    positions.insert(positions.end(), points.begin(), points.end());
-    for (auto i = 0; i < 3; ++i) {
-      colours.push_back(vec4(0.6f, i % 2, i % 3, 1.0f));
+// Indexed sphere made by splitting every edge of a closed base mesh at its normalised midpoint, levels times
+struct sphere_mesh {
+  vector<vec3> positions;
+  vector<GLuint> indices;
+};
+
+// Subdivides each base face as a triangular lattice of 2^levels + 1 points a side, filled coarse to fine
+// with each new point the normalised sum of the two ends of the coarser lattice edge it halves - the same
+// points, bit for bit, as recursing on every triangle.  Vertices are shared through fixed slots: base
+// corners first, then the inner points of each base edge, found through a cache of the base edges so both
+// faces beside an edge use the same run, then the inner points of each face.  Every buffer is sized exactly
+// up front and the faces are filled on separate threads.
+sphere_mesh subdivide_sphere(const vector<vec3> &corners, const vector<uvec3> &faces, unsigned int levels) {
+  const size_t n = size_t(1) << levels;
+  // Slot of the first inner point of each base edge, keyed on its lower corner then its higher one,
+  // and the face that writes it
+  struct edge_slot {
+    size_t first;
+    size_t owner;
+  };
+  unordered_map<uint64_t, edge_slot> edges;
+  auto edge_key = [](GLuint a, GLuint b) { return uint64_t(std::min(a, b)) << 32 | std::max(a, b); };
+  auto next = corners.size();
+  for (size_t f = 0; f < faces.size(); ++f) {
+    for (int k = 0; k < 3; ++k) {
+      auto key = edge_key(faces[f][k], faces[f][(k + 1) % 3]);
+      if (edges.find(key) == edges.end()) {
+        edges[key] = {next, f};
+        next += n - 1;
+      }
     }
   }
+  const size_t face_inner = (n - 1) * (n - 2) / 2;
+  auto face_first = next;
+  auto vertex_count = face_first + faces.size() * face_inner;
+  if (vertex_count > UINT32_MAX) {
+    throw runtime_error("Too many subdivisions for 32-bit indices");
+  }
+
+  sphere_mesh out;
+  out.positions.resize(vertex_count);
+  out.indices.resize(faces.size() * n * n * 3);
+  copy(corners.begin(), corners.end(), out.positions.begin());
+
+  parallel_bands(static_cast<unsigned int>(faces.size()), [&](unsigned int begin, unsigned int end) {
+    // Point (i, j) of the lattice lies i steps from corner 0 towards corner 1 and j towards corner 2
+    vector<vec3> lattice((n + 1) * (n + 2) / 2);
+    auto at = [n](size_t i, size_t j) { return j * (n + 1) - j * (j - 1) / 2 + i; };
+    vector<GLuint> slots(lattice.size());
+    for (auto f = begin; f < end; ++f) {
+      auto &face = faces[f];
+      lattice[at(0, 0)] = corners[face[0]];
+      lattice[at(n, 0)] = corners[face[1]];
+      lattice[at(0, n)] = corners[face[2]];
+      // Each pass halves the spacing; a new point is odd in one or both coordinates at that spacing
+      for (auto step = n / 2; step > 0; step /= 2) {
+        for (size_t j = 0; j <= n; j += step) {
+          for (size_t i = (j / step) % 2 ? 0 : step; i + j <= n; i += (j / step) % 2 ? step : 2 * step) {
+            vec3 a, b;
+            if ((j / step) % 2 == 0) {
+              a = lattice[at(i - step, j)], b = lattice[at(i + step, j)];
+            } else if ((i / step) % 2 == 0) {
+              a = lattice[at(i, j - step)], b = lattice[at(i, j + step)];
+            } else {
+              a = lattice[at(i - step, j + step)], b = lattice[at(i + step, j - step)];
+            }
+            lattice[at(i, j)] = normalize(a + b);
+          }
+        }
+      }
+
+      // Slots of the lattice points: corners and base edges are shared, the inside is the face's own
+      auto edge = [&](GLuint from, GLuint to, size_t t, size_t i, size_t j) {
+        auto &slot = edges.find(edge_key(from, to))->second;
+        // Runs go from the edge's lower corner to its higher one
+        auto index = slot.first + (from < to ? t : n - t) - 1;
+        if (slot.owner == f) {
+          out.positions[index] = lattice[at(i, j)];
+        }
+        slots[at(i, j)] = static_cast<GLuint>(index);
+      };
+      auto inner = face_first + f * face_inner;
+      for (size_t j = 0; j <= n; ++j) {
+        for (size_t i = 0; i + j <= n; ++i) {
+          if (i == 0 && j == 0) {
+            slots[at(i, j)] = face[0];
+          } else if (i == n) {
+            slots[at(i, j)] = face[1];
+          } else if (j == n) {
+            slots[at(i, j)] = face[2];
+          } else if (j == 0) {
+            edge(face[0], face[1], i, i, j);
+          } else if (i == 0) {
+            edge(face[0], face[2], j, i, j);
+          } else if (i + j == n) {
+            edge(face[1], face[2], j, i, j);
+          } else {
+            out.positions[inner] = lattice[at(i, j)];
+            slots[at(i, j)] = static_cast<GLuint>(inner++);
+          }
+        }
+      }
+
+      // Triangles pointing the way the face does, then those between them, wound alike
+      auto index = out.indices.begin() + f * n * n * 3;
+      for (size_t j = 0; j < n; ++j) {
+        for (size_t i = 0; i + j < n; ++i) {
+          *index++ = slots[at(i, j)];
+          *index++ = slots[at(i + 1, j)];
+          *index++ = slots[at(i, j + 1)];
+          if (i + j + 1 < n) {
+            *index++ = slots[at(i + 1, j)];
+            *index++ = slots[at(i + 1, j + 1)];
+            *index++ = slots[at(i, j + 1)];
+          }
+        }
+      }
+    }
+  });
+  return out;
 }
 
 bool load_content() {
-  // Required buffers
-  vector<vec3> positions;
-  vector<vec4> colours;
-
   // Define the initial tetrahedron - 4 points
 
   // vector<vec3> v {
@@ -64,17 +169,21 @@ bool load_content() {
   };
 
   // Divide the triangles
-  divide_triangle({v[0], v[1], v[2]}, subdivisions, positions, colours);
-  divide_triangle({v[3], v[2], v[1]}, subdivisions, positions, colours);
-  divide_triangle({v[0], v[3], v[1]}, subdivisions, positions, colours);
-  divide_triangle({v[0], v[2], v[3]}, subdivisions, positions, colours);
+  auto sphere = subdivide_sphere(v, {uvec3(0, 1, 2), uvec3(3, 2, 1), uvec3(0, 3, 1), uvec3(0, 2, 3)}, subdivisions);
+  // A shared vertex has no single triangle corner to take a colour from, so colour by direction instead
+  vector<vec4> colours(sphere.positions.size());
+  for (size_t i = 0; i < colours.size(); ++i) {
+    auto &p = sphere.positions[i];
+    colours[i] = vec4(0.6f, 0.5f + 0.5f * p.y, 0.5f + 0.5f * p.z, 1.0f);
+  }
 
   // Use Line mode to see what this looks like in wireframe, Hint: It's Wack.
   // geom.set_type(GL_LINES);
 
   // Add to the geometry
-  geom.add_buffer(positions, BUFFER_INDEXES::POSITION_BUFFER);
+  geom.add_buffer(sphere.positions, BUFFER_INDEXES::POSITION_BUFFER);
   geom.add_buffer(colours, BUFFER_INDEXES::COLOUR_BUFFER);
+  geom.add_index_buffer(sphere.indices);
 
   // Load in shaders
   eff.add_shader("shaders/basic.vert", GL_VERTEX_SHADER);
@@ -1,85 +1,151 @@
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include <graphics_framework.h>
+#include <functional>
+#include <thread>
+
+// Private copy of the decoder so it cannot clash with one built into the framework
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
 
 using namespace std;
 using namespace graphics_framework;
 using namespace glm;
 
+// Size of the terrain along x and z, which the splat map is stretched over
+const unsigned int terrain_width = 20;
+const unsigned int terrain_depth = 20;
+
 mesh terr;
 effect eff;
 free_camera cam;
 directional_light light;
 texture tex[4];
+// When set the texture weights are baked into an RGBA8 splat map sampled per
+// fragment, rather than sent as a vec4 with every vertex
+bool use_splat_map = true;
+GLuint splat_map;
+vec2 splat_scale, splat_offset;
+
+// Runs body(begin, end) over contiguous bands of [0, count), one band per hardware thread
+void parallel_bands(unsigned int count, const function<void(unsigned int, unsigned int)> &body) {
+  auto threads = std::max(thread::hardware_concurrency(), 1u);
+  auto band = (count + threads - 1) / threads;
+  vector<thread> workers;
+  for (unsigned int begin = band; begin < count; begin += band) {
+    workers.emplace_back(body, begin, std::min(begin + band, count));
+  }
+  // Calling thread takes the first band
+  body(0, std::min(band, count));
+  for (auto &w : workers) {
+    w.join();
+  }
+}
 
-void generate_terrain(geometry &geom, const texture &height_map, unsigned int width, unsigned int depth,
-                      float height_scale) {
+// Decodes a height map straight into one float per texel (the green channel of colour images),
+// with rows flipped bottom-up to match a GL texture.  No GL context or texture round-trip needed.
+vector<float> load_heights(const string &filename, unsigned int &map_width, unsigned int &map_height) {
+  int w, h, channels;
+  auto pixels = stbi_load(filename.c_str(), &w, &h, &channels, 0);
+  if (!pixels) {
+    throw runtime_error("Could not load height map " + filename);
+  }
+  auto channel = channels >= 3 ? 1 : 0;
+  vector<float> heights(static_cast<size_t>(w) * h);
+  for (int z = 0; z < h; ++z) {
+    for (int x = 0; x < w; ++x) {
+      heights[static_cast<size_t>(z) * w + x] = pixels[(static_cast<size_t>(h - 1 - z) * w + x) * channels + channel] / 255.0f;
+    }
+  }
+  stbi_image_free(pixels);
+  map_width = w;
+  map_height = h;
+  return heights;
+}
+
+// Blend of the four texture layers at a height in the range 0-1, one height band
+// per layer, worked out for all four layers at once
+vec4 texture_weights(float height) {
+  static const vec4 band_centres(0.0f, 0.15f, 0.5f, 0.9f);
+  vec4 tex_weight = clamp(vec4(1.0f) - abs(vec4(height) - band_centres) / 0.25f, vec4(0.0f), vec4(1.0f));
+  // Divide weight by the sum of its components
+  return tex_weight / dot(tex_weight, vec4(1.0f));
+}
+
+// Builds the terrain geometry.  If splat is given the texture weights go into it,
+// one RGBA8 texel per height map sample (row-major), instead of a vertex buffer.
+void generate_terrain(geometry &geom, const vector<float> &heights, unsigned int map_width, unsigned int map_height,
+                      unsigned int width, unsigned int depth, float height_scale, vector<u8vec4> *splat = nullptr) {
+  const size_t vertex_count = static_cast<size_t>(map_width) * map_height;
+
+  // Size every buffer up front so each band can write by index
   // Contains our position data
-  vector<vec3> positions;
+  vector<vec3> positions(vertex_count);
   // Contains our normal data
-  vector<vec3> normals;
+  vector<vec3> normals(vertex_count, vec3(0.0f));
   // Contains our texture coordinate data
-  vector<vec2> tex_coords;
+  vector<vec2> tex_coords(vertex_count);
   // Contains our texture weights
-  vector<vec4> tex_weights;
+  vector<vec4> tex_weights(splat ? 0 : vertex_count);
+  if (splat) {
+    splat->resize(vertex_count);
+  }
   // Contains our index data
-  vector<unsigned int> indices;
-
-  // Extract the texture data from the image
-  glBindTexture(GL_TEXTURE_2D, height_map.get_id());
-  auto data = new vec4[height_map.get_width() * height_map.get_height()];
-  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, (void *)data);
+  vector<unsigned int> indices(static_cast<size_t>(map_width - 1) * (map_height - 1) * 6);
 
   // Determine ratio of height map to geometry
-  float width_point = static_cast<float>(width) / static_cast<float>(height_map.get_width());
-  float depth_point = static_cast<float>(depth) / static_cast<float>(height_map.get_height());
-
-  // Point to work on
-  vec3 point;
-
-  // Part 1 - Iterate through each point, calculate vertex and add to vector
-  for (int x = 0; x < height_map.get_width(); ++x) {
-    // Calculate x position of point
-    point.x = -(width / 2.0f) + (width_point * static_cast<float>(x));
-
-    for (int z = 0; z < height_map.get_height(); ++z) {
-      // *********************************
-      // Calculate z position of point
-      point.z = -(depth / 2.0f) + (depth_point * z);
-      // *********************************
-      // Y position based on red component of height map data
-      point.y = data[(z * height_map.get_width()) + x].y * height_scale;
-      // Add point to position data
-      positions.push_back(point);
+  float width_point = static_cast<float>(width) / static_cast<float>(map_width);
+  float depth_point = static_cast<float>(depth) / static_cast<float>(map_height);
+
+  // Each band of x columns fills its own vertices and cells
+  parallel_bands(map_width, [&](unsigned int begin, unsigned int end) {
+    for (unsigned int x = begin; x < end; ++x) {
+      // Part 1 - Calculate each vertex in the column
+      vec3 point;
+      point.x = -(width / 2.0f) + (width_point * static_cast<float>(x));
+      for (unsigned int z = 0; z < map_height; ++z) {
+        point.z = -(depth / 2.0f) + (depth_point * static_cast<float>(z));
+        // Y position based on the height map data
+        auto height = heights[(z * map_width) + x];
+        point.y = height * height_scale;
+        positions[x * map_height + z] = point;
+        // Part 3 - Texture coordinate
+        tex_coords[x * map_height + z] = vec2(width_point * x, depth_point * z);
+        // Part 4 - Texture weight, blending four height bands
+        auto tex_weight = texture_weights(height);
+        if (splat) {
+          (*splat)[z * map_width + x] = u8vec4(round(tex_weight * 255.0f));
+        } else {
+          tex_weights[x * map_height + z] = tex_weight;
+        }
+      }
+
+      // Part 1 - Index data for the cells to the right of this column
+      if (x == map_width - 1) {
+        continue;
+      }
+      auto idx = static_cast<size_t>(x) * (map_height - 1) * 6;
+      for (unsigned int y = 0; y < map_height - 1; ++y) {
+        // Get four corners of patch
+        unsigned int top_left = (y * map_width) + x;
+        unsigned int top_right = (y * map_width) + x + 1;
+        unsigned int bottom_left = ((y + 1) * map_width) + x;
+        unsigned int bottom_right = ((y + 1) * map_height) + x + 1;
+        // Triangle 1 (tl,br,bl)
+        indices[idx++] = top_left;
+        indices[idx++] = bottom_right;
+        indices[idx++] = bottom_left;
+        // Triangle 2 (tl,tr,br)
+        indices[idx++] = top_left;
+        indices[idx++] = top_right;
+        indices[idx++] = bottom_right;
+      }
     }
-  }
-
-  // Part 1 - Add index data
-  for (unsigned int x = 0; x < height_map.get_width() - 1; ++x) {
-    for (unsigned int y = 0; y < height_map.get_height() - 1; ++y) {
-      // Get four corners of patch
-      unsigned int top_left = (y * height_map.get_width()) + x;
-      unsigned int top_right = (y * height_map.get_width()) + x + 1;
-      // *********************************
-      unsigned int bottom_left = ((y + 1) * height_map.get_width()) + x;
-      unsigned int bottom_right = ((y + 1) * height_map.get_height()) + x + 1;
-      // *********************************
-      // Push back indices for triangle 1 (tl,br,bl)
-      indices.push_back(top_left);
-      indices.push_back(bottom_right);
-      indices.push_back(bottom_left);
-      // Push back indices for triangle 2 (tl,tr,br)
-      // *********************************
-      indices.push_back(top_left);
-      indices.push_back(top_right);
-      indices.push_back(bottom_right);
-      // *********************************
-    }
-  }
-
-  // Resize the normals buffer
-  normals.resize(positions.size());
+  });
 
   // Part 2 - Calculate normals for the height map
+  // Triangles share vertices, so this scatter stays serial
   for (unsigned int i = 0; i < indices.size() / 3; ++i) {
     // Get indices for the triangle
     auto idx1 = indices[i * 3];
@@ -91,59 +157,27 @@ void generate_terrain(geometry &geom, const texture &height_map, unsigned int wi
     vec3 side2 = positions[idx1] - positions[idx2];
 
     // Normal is normal(cross product) of these two sides
-    // *********************************
     vec3 n = normalize(side2 * side1);
 
     // Add to normals in the normal buffer using the indices for the triangle
     normals[idx1] += n;
     normals[idx2] += n;
     normals[idx3] += n;
-    // *********************************
   }
 
   // Normalize all the normals
   for (auto &n : normals) {
-    // *********************************
     n = normalize(n);
-    // *********************************
-  }
-
-  // Part 3 - Add texture coordinates for geometry
-  for (unsigned int x = 0; x < height_map.get_width(); ++x) {
-    for (unsigned int z = 0; z < height_map.get_height(); ++z) {
-      tex_coords.push_back(vec2(width_point * x, depth_point * z));
-    }
-  }
-
-  // Part 4 - Calculate texture weights for each vertex
-  for (unsigned int x = 0; x < height_map.get_width(); ++x) {
-    for (unsigned int z = 0; z < height_map.get_height(); ++z) {
-      // Calculate tex weight
-      vec4 tex_weight(clamp(1.0f - abs(data[(height_map.get_width() * z) + x].y - 0.0f) / 0.25f, 0.0f, 1.0f),
-                      clamp(1.0f - abs(data[(height_map.get_width() * z) + x].y - 0.15f) / 0.25f, 0.0f, 1.0f),
-                      clamp(1.0f - abs(data[(height_map.get_width() * z) + x].y - 0.5f) / 0.25f, 0.0f, 1.0f),
-                      clamp(1.0f - abs(data[(height_map.get_width() * z) + x].y - 0.9f) / 0.25f, 0.0f, 1.0f));
-
-      // *********************************
-      // Sum the components of the vector
-      auto sum = tex_weight.x + tex_weight.y + tex_weight.z + tex_weight.w;
-      // Divide weight by sum
-      tex_weight /= sum;
-      // Add tex weight to weights
-      tex_weights.push_back(tex_weight);
-      // *********************************
-    }
   }
 
   // Add necessary buffers to the geometry
   geom.add_buffer(positions, BUFFER_INDEXES::POSITION_BUFFER);
   geom.add_buffer(normals, BUFFER_INDEXES::NORMAL_BUFFER);
   geom.add_buffer(tex_coords, BUFFER_INDEXES::TEXTURE_COORDS_0);
-  geom.add_buffer(tex_weights, BUFFER_INDEXES::TEXTURE_COORDS_1);
+  if (!splat) {
+    geom.add_buffer(tex_weights, BUFFER_INDEXES::TEXTURE_COORDS_1);
+  }
   geom.add_index_buffer(indices);
-
-  // Delete data
-  delete[] data;
 }
 
 bool load_content() {
@@ -151,10 +185,27 @@ bool load_content() {
   geometry geom;
 
   // Load height map
-  texture height_map("textures/sinemap.png");
+  unsigned int map_width, map_height;
+  auto heights = load_heights("textures/sinemap.png", map_width, map_height);
 
   // Generate terrain
-  generate_terrain(geom, height_map, 20, 20, 2.0f);
+  vector<u8vec4> splat;
+  generate_terrain(geom, heights, map_width, map_height, terrain_width, terrain_depth, 2.0f,
+                   use_splat_map ? &splat : nullptr);
+  if (use_splat_map) {
+    glGenTextures(1, &splat_map);
+    glBindTexture(GL_TEXTURE_2D, splat_map);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, map_width, map_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, splat.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    // Texture coordinates are width / map_width per sample; this maps them onto
+    // the centre of each sample's texel
+    splat_scale = vec2(1.0f / terrain_width, 1.0f / terrain_depth);
+    splat_offset = vec2(0.5f / map_width, 0.5f / map_height);
+  }
 
   // Use geometry to create terrain mesh
   terr = mesh(geom);
@@ -164,6 +215,8 @@ bool load_content() {
   eff.add_shader("60_Terrain/terrain.frag", GL_FRAGMENT_SHADER);
   eff.add_shader("shaders/part_direction.frag", GL_FRAGMENT_SHADER);
   eff.add_shader("60_Terrain/part_weighted_texture_4.frag", GL_FRAGMENT_SHADER);
+  eff.add_shader(use_splat_map ? "60_Terrain/part_splat_weights.frag" : "60_Terrain/part_vertex_weights.frag",
+                 GL_FRAGMENT_SHADER);
   // Build effect
   eff.build();
 
@@ -269,6 +322,14 @@ bool render() {
   // Bind Tex[3] to TU 3, set uniform
   renderer::bind(tex[3], 3);
   glUniform1i(eff.get_uniform_location("tex[3]"), 3);
+  // Bind the splat map to TU 4
+  if (use_splat_map) {
+    glActiveTexture(GL_TEXTURE0 + 4);
+    glBindTexture(GL_TEXTURE_2D, splat_map);
+    glUniform1i(eff.get_uniform_location("splat"), 4);
+    glUniform2fv(eff.get_uniform_location("splat_scale"), 1, value_ptr(splat_scale));
+    glUniform2fv(eff.get_uniform_location("splat_offset"), 1, value_ptr(splat_offset));
+  }
   // *********************************
   // Render terrain
   renderer::render(terr);
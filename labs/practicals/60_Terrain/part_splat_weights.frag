@@ -0,0 +1,12 @@
+#version 440
+
+// Splat map holding the four texture weights of each height map sample
+uniform sampler2D splat;
+// Map from the terrain texture coordinate to the splat map
+uniform vec2 splat_scale;
+uniform vec2 splat_offset;
+
+// Texture weights read from the splat map; the vertex weights are unused
+vec4 terrain_weights(in vec2 tex_coord, in vec4 vertex_weights) {
+  return texture(splat, tex_coord * splat_scale + splat_offset);
+}
@@ -0,0 +1,6 @@
+#version 440
+
+// Texture weights sent with each vertex
+vec4 terrain_weights(in vec2 tex_coord, in vec4 vertex_weights) {
+  return vertex_weights;
+}
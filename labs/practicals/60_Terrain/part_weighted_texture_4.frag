@@ -3,11 +3,22 @@
 vec4 weighted_texture(in sampler2D tex[4], in vec2 tex_coord, in vec4 weights) {
   vec4 tex_colour = vec4(0, 0, 0, 1);
   // *********************************
-  // Sample all Five textures based on weight
-  tex_colour += texture(tex[0], tex_coord) * weights.x;
-  tex_colour += texture(tex[1], tex_coord) * weights.y;
-  tex_colour += texture(tex[2], tex_coord) * weights.z;
-  tex_colour += texture(tex[3], tex_coord) * weights.w;
+  // Gradients are taken up front, as they are undefined inside the branches below
+  vec2 dx = dFdx(tex_coord);
+  vec2 dy = dFdy(tex_coord);
+  // Sample only the textures that have a weight - most fragments need one or two
+  if (weights.x > 0.0) {
+    tex_colour += textureGrad(tex[0], tex_coord, dx, dy) * weights.x;
+  }
+  if (weights.y > 0.0) {
+    tex_colour += textureGrad(tex[1], tex_coord, dx, dy) * weights.y;
+  }
+  if (weights.z > 0.0) {
+    tex_colour += textureGrad(tex[2], tex_coord, dx, dy) * weights.z;
+  }
+  if (weights.w > 0.0) {
+    tex_colour += textureGrad(tex[3], tex_coord, dx, dy) * weights.w;
+  }
   // *********************************
   return tex_colour;
-}
\ No newline at end of file
+}
@@ -1,6 +1,6 @@
 #version 440
 
-// Requires weighted_texture.frag
+// Requires weighted_texture.frag, and part_vertex_weights.frag or part_splat_weights.frag
 
 // A directional light structure
 struct directional_light {
@@ -17,8 +17,9 @@ struct material {
   float shininess;
 };
 
-// Forward declaration
+// Forward declarations
 vec4 weighted_texture(in sampler2D tex[4], in vec2 tex_coord, in vec4 weights);
+vec4 terrain_weights(in vec2 tex_coord, in vec4 vertex_weights);
 
 // Directional light for the scene
 uniform directional_light light;
@@ -54,7 +55,7 @@ void main() {
   vec4 specular = (mat.specular_reflection * light.light_colour) * pow(max(dot(normal, half_vector), 0), mat.shininess);
 
   // Get tex colour
-  vec4 tex_colour = weighted_texture(tex, tex_coord, tex_weight);
+  vec4 tex_colour = weighted_texture(tex, tex_coord, terrain_weights(tex_coord, tex_weight));
   // Calculate primary colour component
   vec4 primary = mat.emissive + ambient + diffuse;
   // Calculate final colour
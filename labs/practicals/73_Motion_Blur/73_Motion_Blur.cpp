@@ -53,8 +53,9 @@ bool load_content() {
   // Create plane mesh
   meshes["plane"] = mesh(geometry_builder::create_plane());
 
-  // Create scene
-  meshes["box"] = mesh(geometry_builder::create_box());
+  // Create scene - the box and the chaser share one box's buffers
+  auto box = geometry_builder::create_box();
+  meshes["box"] = mesh(box);
   meshes["tetra"] = mesh(geometry_builder::create_tetrahedron());
   meshes["pyramid"] = mesh(geometry_builder::create_pyramid());
   meshes["disk"] = mesh(geometry_builder::create_disk(20));
@@ -80,7 +81,7 @@ bool load_content() {
   meshes["torus"].get_transform().rotate(vec3(half_pi<float>(), 0.0f, 0.0f));
 
   // Create mesh to chase
-  meshes["chaser"] = mesh(geometry_builder::create_box());
+  meshes["chaser"] = mesh(box);
   meshes["chaser"].get_transform().position = vec3(0.0f, 0.5f, 0.0f);
 
   // Set materials